@@ -0,0 +1,242 @@
+// Deterministic generator of large SysY programs for bench_compile.
+// usage: bench_gen <profile> [scale] [seed] > out.sy
+// profiles: functions, nesting, loops, arrays, exprs, globals, mixed
+// The same arguments always produce the same bytes.
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class Rng
+{
+private:
+    uint64_t state;
+
+public:
+    Rng(uint64_t seed) : state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+    uint32_t next()
+    {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state >> 32;
+    }
+    int range(int lo, int hi) { return lo + next() % (hi - lo + 1); }
+    template <typename T>
+    const T &pick(const std::vector<T> &v) { return v[next() % v.size()]; }
+};
+
+struct Profile
+{
+    int functions = 0;
+    int nesting = 0;
+    int loops = 0;
+    int expr_terms = 0;
+    int globals = 0;
+    int global_arrays = 0;
+    std::vector<int> array_dims;
+    int local_arrays = 0;
+};
+
+static Rng rng(1);
+static std::string out;
+
+static void line(int tabs, const std::string &text)
+{
+    out.append(tabs * 4, ' ');
+    out += text;
+    out += '\n';
+}
+
+static std::string expr(int terms, const std::vector<std::string> &vars)
+{
+    static const char *ops[] = {" + ", " - ", " * ", " + ", " - "};
+    std::string result = rng.pick(vars);
+    for (int i = 1; i < terms; i++)
+    {
+        result += ops[rng.next() % 5];
+        if (rng.next() % 4 == 0)
+            result += "(" + rng.pick(vars) + " / " + std::to_string(rng.range(3, 9)) + ")";
+        else if (rng.next() % 3 == 0)
+            result += std::to_string(rng.range(1, 100));
+        else
+            result += rng.pick(vars);
+    }
+    return result;
+}
+
+// nested initializer for dims[level..], leaving some sub-lists short or empty
+static std::string init_list(const std::vector<int> &dims, size_t level)
+{
+    if (level == dims.size())
+        return std::to_string(rng.range(0, 3) ? rng.range(1, 1000) : 0);
+    int n = dims[level];
+    int filled = rng.range(0, 3) ? n : rng.range(0, n);
+    std::string result = "{";
+    for (int i = 0; i < filled; i++)
+    {
+        if (i)
+            result += ", ";
+        result += init_list(dims, level + 1);
+    }
+    return result + "}";
+}
+
+static std::string dims_decl(const std::vector<int> &dims)
+{
+    std::string result;
+    for (int d : dims)
+        result += "[" + std::to_string(d) + "]";
+    return result;
+}
+
+static void nested(int depth, int max_depth, int tabs, const std::vector<std::string> &vars)
+{
+    if (depth == max_depth)
+    {
+        line(tabs, "s = s + " + expr(4, vars) + ";");
+        return;
+    }
+    std::string v = "v" + std::to_string(depth);
+    if (depth % 2 == 0)
+    {
+        line(tabs, "int " + v + " = 0;");
+        line(tabs, "while (" + v + " < " + std::to_string(rng.range(2, 5)) + ") {");
+        auto inner = vars;
+        inner.push_back(v);
+        nested(depth + 1, max_depth, tabs + 1, inner);
+        line(tabs + 1, "if (s > " + std::to_string(rng.range(1000, 9999)) + ") break;");
+        line(tabs + 1, v + " = " + v + " + 1;");
+        line(tabs, "}");
+    }
+    else
+    {
+        line(tabs, "if (" + rng.pick(vars) + " % " + std::to_string(rng.range(2, 7)) + " == 1 && s < 100000) {");
+        nested(depth + 1, max_depth, tabs + 1, vars);
+        line(tabs, "} else {");
+        line(tabs + 1, "s = s - " + rng.pick(vars) + ";");
+        line(tabs, "}");
+    }
+}
+
+// one while per level, each with its own continue and break
+static void loops(int depth, int max_depth, int tabs, const std::vector<std::string> &vars)
+{
+    if (depth == max_depth)
+    {
+        line(tabs, "s = s + " + expr(4, vars) + ";");
+        return;
+    }
+    // every level loops a few times but enters the next only on its last
+    // trip, so the whole nest runs its innermost statement once per call
+    std::string v = "w" + std::to_string(depth), trips = std::to_string(rng.range(2, 5));
+    line(tabs, "int " + v + " = 0;");
+    line(tabs, "while (" + v + " < " + trips + ") {");
+    line(tabs + 1, v + " = " + v + " + 1;");
+    line(tabs + 1, "if (" + v + " < " + trips + ") continue;");
+    auto inner = vars;
+    inner.push_back(v);
+    loops(depth + 1, max_depth, tabs + 1, inner);
+    line(tabs + 1, "if (s > " + std::to_string(rng.range(1000, 9999)) + ") break;");
+    line(tabs, "}");
+}
+
+// an index into a dimension of size n that stays in bounds when v is negative
+static std::string wrap(const std::string &v, int n)
+{
+    return "(" + v + " % " + std::to_string(n) + " + " + std::to_string(n) + ") % " + std::to_string(n);
+}
+
+static void function(int index, const Profile &p)
+{
+    std::string name = "f" + std::to_string(index);
+    line(0, "int " + name + "(int a, int b, int c[]) {");
+    std::vector<std::string> vars = {"a", "b", "x", "y", "c[1]"};
+    if (p.globals)
+        for (int i = 0; i < 3; i++)
+            vars.push_back("g" + std::to_string(rng.range(0, p.globals - 1)));
+    line(1, "int x = a + 1, y = b - 1, s = 0;");
+    for (int i = 0; i < p.local_arrays; i++)
+        line(1, "int l" + std::to_string(i) + "[8][4] = " + init_list({8, 4}, 0) + ";");
+    if (p.local_arrays)
+        vars.push_back("l0[" + wrap("x", 8) + "][" + wrap("y", 4) + "]");
+    if (p.expr_terms)
+        line(1, "s = " + expr(p.expr_terms, vars) + ";");
+    if (p.nesting)
+        nested(0, p.nesting, 1, vars);
+    else if (p.loops)
+        loops(0, p.loops, 1, vars);
+    else
+    {
+        line(1, "int i = 0;");
+        line(1, "while (i < 10) {");
+        line(2, "if (x > y || i == 3) x = x - " + rng.pick(vars) + "; else y = y + 1;");
+        line(2, "s = s + " + expr(6, vars) + ";");
+        line(2, "i = i + 1;");
+        line(1, "}");
+    }
+    if (p.global_arrays)
+    {
+        std::string access = "ga" + std::to_string(index % p.global_arrays) + "[" + wrap("x", p.array_dims[0]) + "]";
+        for (size_t i = 1; i < p.array_dims.size(); i++)
+            access += "[" + std::to_string(rng.range(0, p.array_dims[i] - 1)) + "]";
+        line(1, "s = s + " + access + ";");
+    }
+    if (index)
+        line(1, "s = s + f" + std::to_string(rng.range(0, index - 1)) + "(x, y, c);");
+    line(1, "return s;");
+    line(0, "}");
+    line(0, "");
+}
+
+int main(int argc, const char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "usage: " << argv[0] << " functions|nesting|loops|arrays|exprs|globals|mixed [scale] [seed]" << std::endl;
+        return 1;
+    }
+    std::string name = argv[1];
+    int scale = argc > 2 ? atoi(argv[2]) : 1;
+    rng = Rng(argc > 3 ? atoi(argv[3]) : 1);
+
+    Profile p;
+    if (name == "functions")
+        p.functions = 3000 * scale;
+    else if (name == "nesting")
+        p.functions = 150 * scale, p.nesting = 50;
+    else if (name == "loops")
+        p.functions = 150 * scale, p.loops = 50;
+    else if (name == "arrays")
+        p.functions = 50 * scale, p.global_arrays = 6 * scale, p.array_dims = {64, 64, 16}, p.local_arrays = 4;
+    else if (name == "exprs")
+        p.functions = 100 * scale, p.expr_terms = 1500;
+    else if (name == "globals")
+        p.functions = 300 * scale, p.globals = 10000 * scale;
+    else if (name == "mixed")
+        p.functions = 600 * scale, p.nesting = 12, p.expr_terms = 60, p.globals = 2000 * scale,
+        p.global_arrays = 2, p.array_dims = {32, 16, 8}, p.local_arrays = 1;
+    else
+    {
+        std::cerr << "unknown profile " << name << std::endl;
+        return 1;
+    }
+
+    for (int i = 0; i < p.globals; i++)
+        line(0, (i % 5 ? "int g" : "const int g") + std::to_string(i) + " = " + std::to_string(rng.range(0, 1 << 20)) + ";");
+    for (int i = 0; i < p.global_arrays; i++)
+        line(0, "int ga" + std::to_string(i) + dims_decl(p.array_dims) + " = " + init_list(p.array_dims, 0) + ";");
+    line(0, "");
+    for (int i = 0; i < p.functions; i++)
+        function(i, p);
+    line(0, "int main() {");
+    line(1, "int arr[4] = {1, 2, 3, 4};");
+    line(1, "putint(f" + std::to_string(p.functions - 1) + "(1, 2, arr));");
+    line(1, "return 0;");
+    line(0, "}");
+    std::cout << out;
+    return 0;
+}
@@ -0,0 +1,102 @@
+// Lexer throughput: tokenizes a SysY file through the old fopen/yyin path
+// and through SourceBuffer + yy_scan_buffer, and prints MB/s for both.
+// usage: bench_lex [file.sy] [repeats]
+// Without a file, a synthetic source of about 8MB is written to /tmp.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <source.h>
+#include "sysy.tab.hpp"
+
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern FILE *yyin;
+extern int yylex();
+extern void yyrestart(FILE *file);
+extern YY_BUFFER_STATE yy_scan_buffer(char *base, size_t size);
+extern int yylex_destroy();
+
+// the parser is not linked, so the lexer's yylval and yylloc live here
+YYSTYPE yylval;
+YYLTYPE yylloc;
+
+static std::string generate(size_t target)
+{
+    std::string path = "/tmp/bench_lex_" + std::to_string(getpid()) + ".sy";
+    std::ofstream out(path);
+    out << "const int N = 1024;\nint g[N][4] = {{1, 2}, {3}, 0x1f, 017};\n";
+    size_t written = 0;
+    for (int i = 0; written < target; i++)
+    {
+        std::string f = "int func_" + std::to_string(i) + "(int a, int b[], int c[][4])\n{\n"
+            "    // line comment " + std::to_string(i) + "\n"
+            "    int x = a * 3 + b[0] - c[1][2] / 7 % 5, y = 0;\n"
+            "    /* block\n       comment */\n"
+            "    while (x > 0 && y <= 100 || !(x == y)) {\n"
+            "        if (x != 1) y = y + x; else { x = x - 1; continue; }\n"
+            "        x = x - 1;\n"
+            "        if (y >= 65535) break;\n"
+            "    }\n"
+            "    return x + y + g[" + std::to_string(i % 1024) + "][1];\n}\n\n";
+        out << f;
+        written += f.size();
+    }
+    return path;
+}
+
+static size_t drain()
+{
+    size_t tokens = 0;
+    int tok;
+    while ((tok = yylex()))
+        tokens++;
+    return tokens;
+}
+
+int main(int argc, const char *argv[])
+{
+    std::string path = argc > 1 ? argv[1] : generate(8 << 20);
+    int repeats = argc > 2 ? atoi(argv[2]) : 5;
+    SourceBuffer probe;
+    if (!probe.open(path))
+    {
+        std::cerr << "cannot open " << path << std::endl;
+        return 1;
+    }
+    double mb = probe.get_size() / 1048576.0;
+    probe.close();
+
+    double best_stdio = 1e30, best_buffer = 1e30;
+    size_t tokens_stdio = 0, tokens_buffer = 0;
+    for (int r = 0; r < repeats; r++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        yyin = fopen(path.c_str(), "r");
+        yyrestart(yyin);
+        tokens_stdio = drain();
+        yylex_destroy();
+        fclose(yyin);
+        yyin = nullptr;
+        best_stdio = std::min(best_stdio, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        start = std::chrono::steady_clock::now();
+        SourceBuffer source;
+        source.open(path);
+        yy_scan_buffer(source.get_lex_base(), source.get_lex_size());
+        tokens_buffer = drain();
+        yylex_destroy();
+        source.close();
+        best_buffer = std::min(best_buffer, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    if (argc <= 1)
+        remove(path.c_str());
+
+    printf("input: %.2f MB, %zu tokens\n", mb, tokens_buffer);
+    printf("stdio  (fopen + yyin):        %8.2f MB/s\n", mb / best_stdio);
+    printf("buffer (mmap + scan_buffer):  %8.2f MB/s\n", mb / best_buffer);
+    return tokens_stdio == tokens_buffer ? 0 : 1;
+}
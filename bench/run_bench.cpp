@@ -0,0 +1,281 @@
+// Runs the compiler over every bench_gen profile in -koopa and -riscv mode,
+// records the best wall time and the peak RSS, and compares them with a
+// stored baseline. It also prints the backend time per IR instruction, taken
+// as the -riscv minus the -koopa time over the instructions in the Koopa
+// output.
+// The spill code of each profile is counted too: the stack slot loads and
+// stores --spill-stats reports, and with --sim the ones the program runs
+// on rv_sim. Both are kept in the baseline as "<profile> spills" rows.
+// usage: bench_runner --compiler <path> --gen <path> --work <dir>
+//                     [--baseline <file>] [--update-baseline] [--repeats N]
+//                     [--scale N] [--time-tolerance F] [--mem-tolerance F]
+//                     [--sim <path>]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+static const char *profiles[] = {"functions", "nesting", "loops", "arrays", "exprs", "globals", "mixed"};
+static const char *modes[] = {"koopa", "riscv"};
+
+struct Result
+{
+    double wall_ms = 0;
+    long rss_kb = 0;
+};
+
+// spill loads and stores in the code and, -1 without a simulator, run
+struct Spills
+{
+    long loads = 0, stores = 0;
+    long run_loads = -1, run_stores = -1;
+};
+
+// runs argv with stdout redirected to out_path (or /dev/null) and stderr to
+// err_path (or /dev/null), returns false on failure
+static bool run(const std::vector<std::string> &args, const std::string out_path, Result &result, const std::string err_path = "")
+{
+    std::vector<char *> argv;
+    for (auto &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int out = open(out_path.empty() ? "/dev/null" : out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open(err_path.empty() ? "/dev/null" : err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status;
+    rusage usage;
+    if (pid < 0 || wait4(pid, &status, 0, &usage) < 0)
+        return false;
+    result.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    result.rss_kb = usage.ru_maxrss;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// counts the instructions in a Koopa file: indented lines that are not notes
+static long count_instructions(const std::string path)
+{
+    std::ifstream in(path);
+    std::string line;
+    long count = 0;
+    while (std::getline(in, line))
+        count += line.size() > 2 && line.compare(0, 2, "  ") == 0 && line[2] != '/';
+    return count;
+}
+
+// the number following label in the file at path, or -1
+static long find_count(const std::string path, const std::string label)
+{
+    std::ifstream in(path);
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    size_t pos = text.find(label);
+    return pos == std::string::npos ? -1 : atol(text.c_str() + pos + label.size());
+}
+
+// the leading comment lines, but the column line written on each update, go to notes
+static std::map<std::string, Result> load_baseline(const std::string path, std::string &notes, std::map<std::string, Spills> &spills)
+{
+    std::map<std::string, Result> baseline;
+    std::ifstream in(path);
+    std::string line;
+    bool leading = true;
+    while (std::getline(in, line))
+    {
+        if (leading && !line.empty() && line[0] == '#')
+        {
+            if (line.rfind("# profile mode ", 0) != 0)
+                notes += line + "\n";
+            continue;
+        }
+        leading = false;
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string profile, mode;
+        Result result;
+        Spills counts;
+        if (line.find(" spills ") != std::string::npos)
+        {
+            if (fields >> profile >> mode >> counts.loads >> counts.stores >> counts.run_loads >> counts.run_stores)
+                spills[profile] = counts;
+        }
+        else if (fields >> profile >> mode >> result.wall_ms >> result.rss_kb)
+            baseline[profile + " " + mode] = result;
+    }
+    return baseline;
+}
+
+int main(int argc, const char *argv[])
+{
+    std::string compiler, gen, work, baseline_path, sim;
+    bool update = false;
+    int repeats = 3, scale = 1;
+    double time_tolerance = 0.25, mem_tolerance = 0.10;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--compiler" && has_value)
+            compiler = argv[++i];
+        else if (arg == "--gen" && has_value)
+            gen = argv[++i];
+        else if (arg == "--work" && has_value)
+            work = argv[++i];
+        else if (arg == "--baseline" && has_value)
+            baseline_path = argv[++i];
+        else if (arg == "--update-baseline")
+            update = true;
+        else if (arg == "--repeats" && has_value)
+            repeats = atoi(argv[++i]);
+        else if (arg == "--scale" && has_value)
+            scale = atoi(argv[++i]);
+        else if (arg == "--time-tolerance" && has_value)
+            time_tolerance = atof(argv[++i]);
+        else if (arg == "--mem-tolerance" && has_value)
+            mem_tolerance = atof(argv[++i]);
+        else if (arg == "--sim" && has_value)
+            sim = argv[++i];
+        else
+        {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+    if (compiler.empty() || gen.empty() || work.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " --compiler <path> --gen <path> --work <dir> [--baseline <file>] [--update-baseline] [--sim <path>]" << std::endl;
+        return 2;
+    }
+    mkdir(work.c_str(), 0755);
+    std::string notes;
+    std::map<std::string, Spills> base_spills;
+    auto baseline = load_baseline(baseline_path, notes, base_spills);
+
+    std::ostringstream fresh;
+    fresh << "# profile mode wall_ms peak_rss_kb (scale " << scale << ", best of " << repeats
+          << "), profile spills loads stores run_loads run_stores" << std::endl;
+    fresh << notes;
+    int regressions = 0, failures = 0;
+    std::map<std::string, double> best_ms;
+    printf("%-10s %-6s %10s %10s %7s %10s %10s %7s\n", "profile", "mode", "wall(ms)", "base", "ratio", "rss(KB)", "base", "ratio");
+    for (auto profile : profiles)
+    {
+        std::string source = work + "/" + profile + ".sy";
+        Result ignored;
+        if (!run({gen, profile, std::to_string(scale)}, source, ignored))
+        {
+            std::cerr << "generator failed for " << profile << std::endl;
+            return 2;
+        }
+        for (auto mode : modes)
+        {
+            Result best;
+            bool ok = true;
+            for (int r = 0; r < repeats && ok; r++)
+            {
+                Result result;
+                ok = run({compiler, std::string("-") + mode, source, "-o", work + "/" + profile + "." + mode}, "", result);
+                if (!r || result.wall_ms < best.wall_ms)
+                    best.wall_ms = result.wall_ms;
+                best.rss_kb = std::max(best.rss_kb, result.rss_kb);
+            }
+            if (!ok)
+            {
+                printf("%-10s %-6s FAILED\n", profile, mode);
+                failures++;
+                continue;
+            }
+            fresh << profile << " " << mode << " " << (long)best.wall_ms << " " << best.rss_kb << std::endl;
+            best_ms[std::string(profile) + " " + mode] = best.wall_ms;
+            auto it = baseline.find(std::string(profile) + " " + mode);
+            if (it == baseline.end())
+            {
+                printf("%-10s %-6s %10.0f %10s %7s %10ld %10s %7s\n", profile, mode, best.wall_ms, "-", "-", best.rss_kb, "-", "-");
+                continue;
+            }
+            double time_ratio = best.wall_ms / it->second.wall_ms;
+            double mem_ratio = (double)best.rss_kb / it->second.rss_kb;
+            bool slow = time_ratio > 1 + time_tolerance, fat = mem_ratio > 1 + mem_tolerance;
+            printf("%-10s %-6s %10.0f %10.0f %6.2fx %10ld %10ld %6.2fx%s\n", profile, mode, best.wall_ms, it->second.wall_ms,
+                   time_ratio, best.rss_kb, it->second.rss_kb, mem_ratio, (slow || fat) ? "  REGRESSION" : "");
+            regressions += slow || fat;
+        }
+    }
+    printf("\n%-10s %10s %12s %10s\n", "profile", "ir_instrs", "backend(ms)", "us/instr");
+    long total_instrs = 0;
+    double total_ms = 0;
+    auto print_backend = [](const char *name, long instrs, double backend_ms)
+    { printf("%-10s %10ld %12.0f %10.3f\n", name, instrs, backend_ms, instrs ? backend_ms * 1000 / instrs : 0.0); };
+    for (auto profile : profiles)
+    {
+        std::string name = profile;
+        if (!best_ms.count(name + " koopa") || !best_ms.count(name + " riscv"))
+            continue;
+        long instrs = count_instructions(work + "/" + name + ".koopa");
+        double backend_ms = best_ms[name + " riscv"] - best_ms[name + " koopa"];
+        print_backend(profile, instrs, backend_ms);
+        total_instrs += instrs, total_ms += backend_ms;
+    }
+    // single profiles are noisy, the total much less so
+    print_backend("total", total_instrs, total_ms);
+
+    // the spill counts are exact, so any change shows, but none is a failure
+    printf("\n%-10s %10s %10s %10s %10s %10s %10s\n", "profile", "spill_ld", "spill_st", "run_ld", "run_st", "base_ld", "base_st");
+    for (auto profile : profiles)
+    {
+        std::string source = work + "/" + profile + ".sy", asm_path = work + "/" + profile + ".spills.S";
+        std::string err_path = work + "/" + profile + ".spills";
+        Result ignored;
+        Spills counts;
+        if (!run({compiler, "-riscv", source, "-o", asm_path, "--spill-stats"}, "", ignored, err_path))
+        {
+            printf("%-10s FAILED\n", profile);
+            failures++;
+            continue;
+        }
+        counts.loads = find_count(err_path, "spill code: ");
+        counts.stores = find_count(err_path, "loads, ");
+        if (!sim.empty())
+        {
+            if (!run({sim, asm_path, "/dev/null", "--stats"}, "", ignored, err_path))
+            {
+                printf("%-10s FAILED on %s\n", profile, sim.c_str());
+                failures++;
+                continue;
+            }
+            counts.run_loads = find_count(err_path, "spill loads ");
+            counts.run_stores = find_count(err_path, "spill stores ");
+        }
+        fresh << profile << " spills " << counts.loads << " " << counts.stores << " " << counts.run_loads << " " << counts.run_stores << std::endl;
+        auto it = base_spills.find(profile);
+        auto column = [](long count) { return count < 0 ? std::string("-") : std::to_string(count); };
+        printf("%-10s %10ld %10ld %10s %10s %10s %10s\n", profile, counts.loads, counts.stores, column(counts.run_loads).c_str(),
+               column(counts.run_stores).c_str(), it == base_spills.end() ? "-" : column(it->second.run_loads).c_str(),
+               it == base_spills.end() ? "-" : column(it->second.run_stores).c_str());
+    }
+    if (update && !baseline_path.empty())
+    {
+        std::ofstream(baseline_path) << fresh.str();
+        printf("baseline written to %s\n", baseline_path.c_str());
+    }
+    return (failures || (regressions && !update)) ? 1 : 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <type_traits>
+
+// bump allocator: objects live until reset() or the arena itself dies
+class Arena
+{
+private:
+    // placed right in front of every object that needs its destructor run
+    struct alignas(16) DtorNode
+    {
+        DtorNode *prev;
+        void (*dtor)(void *);
+    };
+    static const size_t CHUNK_SIZE = 64 * 1024;
+    std::vector<std::unique_ptr<char[]>> chunks;
+    std::vector<std::unique_ptr<Arena>> children;
+    DtorNode *last_dtor = nullptr;
+    char *cur = nullptr;
+    size_t left = 0;
+    size_t bytes = 0;
+    size_t objects = 0;
+
+public:
+    Arena() = default;
+    Arena(const Arena &) = delete;
+    Arena &operator=(const Arena &) = delete;
+    ~Arena() { reset(); }
+    template <typename T, typename... Args>
+    T *make(Args &&...args)
+    {
+        static_assert(alignof(T) <= alignof(DtorNode), "over-aligned arena object");
+        objects++;
+        if (std::is_trivially_destructible<T>::value)
+            return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+        auto node = static_cast<DtorNode *>(allocate(sizeof(DtorNode) + sizeof(T), alignof(DtorNode)));
+        T *obj = new (node + 1) T(std::forward<Args>(args)...);
+        *node = {last_dtor, [](void *p) { static_cast<T *>(p)->~T(); }};
+        last_dtor = node;
+        return obj;
+    }
+    void *allocate(size_t size, size_t align);
+    // child is released along with this arena, after this arena's destructors
+    // have run and before its memory goes, so objects may point across the two
+    void adopt(std::unique_ptr<Arena> child) { children.push_back(std::move(child)); }
+    void reset();
+    size_t get_bytes() const { return bytes; }
+    size_t get_objects() const { return objects; }
+    size_t get_chunks() const { return chunks.size(); }
+};
+
+// the arena owns the object, so dropping the pointer does nothing
+struct ArenaDeleter
+{
+    template <typename T>
+    void operator()(T *) const {}
+};
+
+template <typename T>
+using arena_ptr = std::unique_ptr<T, ArenaDeleter>;
+
+// lets standard containers draw their storage from an arena
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+    Arena *arena;
+    ArenaAllocator(Arena *arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+};
+
+template <typename T, typename... Args>
+arena_ptr<T> make_arena(Arena &arena, Args &&...args)
+{
+    return arena_ptr<T>(arena.make<T>(std::forward<Args>(args)...));
+}
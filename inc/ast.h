@@ -8,6 +8,36 @@
 
 #include <ir.h>
 #include <list.h>
+#include <arena.h>
+#include <symbol.h>
+
+class BaseAST;
+
+// owns every AST node; the whole tree is released in one go
+extern Arena ast_arena;
+// set on threads lowering functions in parallel, so the nodes they add to the
+// tree come from an arena of their own, which ast_arena adopts afterwards
+extern thread_local Arena *local_ast_arena;
+inline Arena &current_ast_arena() { return local_ast_arena ? *local_ast_arena : ast_arena; }
+
+// list nodes of the AST come from the same arena and are never freed one by one
+template <typename T>
+struct ASTAllocator
+{
+    using value_type = T;
+    ASTAllocator() = default;
+    template <typename U>
+    ASTAllocator(const ASTAllocator<U> &) {}
+    T *allocate(size_t n) { return static_cast<T *>(current_ast_arena().allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+    template <typename U>
+    bool operator==(const ASTAllocator<U> &) const { return true; }
+    template <typename U>
+    bool operator!=(const ASTAllocator<U> &) const { return false; }
+};
+
+template <typename T>
+using ASTList = List<T, ASTAllocator<T>>;
 
 class BaseAST {
     public:
@@ -19,13 +49,15 @@ class BaseAST {
 class StmtAST : public BaseAST {
     public:
         std::string type;
+        // source line the statement starts on, 0 if unknown
+        unsigned line = 0;
         virtual void to_string(std::string &str, const int tabs = 0) const = 0;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const = 0;
 };
 
 class BlockAST : public StmtAST {
     public:
-        List<std::unique_ptr<StmtAST>> stmts;
+        ASTList<arena_ptr<StmtAST>> stmts;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
@@ -33,12 +65,12 @@ class BlockAST : public StmtAST {
 class ExpAST : public BaseAST {
     public:
         std::string op = "";
-        std::optional<std::string> value = std::nullopt;
-        List<std::unique_ptr<ExpAST>> args;
-        std::optional<std::string> arr_name = std::nullopt;
+        std::optional<Symbol> value = std::nullopt;
+        ASTList<arena_ptr<ExpAST>> args;
+        std::optional<Symbol> arr_name = std::nullopt;
         bool side_effect;
         void try_eval(std::weak_ptr<IRINFO> info);
-        std::unique_ptr<ExpAST> copy() const;
+        arena_ptr<ExpAST> copy() const;
         virtual void to_string(std::string &str, const int tabs = 0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
@@ -46,73 +78,75 @@ class ExpAST : public BaseAST {
 class FuncDefAST : public BaseAST {
     public:
         std::string func_type;
-        std::string ident;
-        std::unique_ptr<BlockAST> block;
-        List<std::pair<std::string, List<std::optional<std::unique_ptr<ExpAST>>>>> args;
+        Symbol ident;
+        arena_ptr<BlockAST> block;
+        ASTList<std::pair<Symbol, ASTList<std::optional<arena_ptr<ExpAST>>>>> args;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
 
 class FuncFPAST : public BaseAST {
     public:
-        std::string name;
-        List<std::optional<std::unique_ptr<ExpAST>>> dims;
+        Symbol name;
+        ASTList<std::optional<arena_ptr<ExpAST>>> dims;
         virtual void to_string(std::string& str, const int tabs=0) const {};
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const { assert(0); };
 };
 
 class FuncFPsAST : public BaseAST {
     public:
-        List<std::unique_ptr<FuncFPAST>> args;
+        ASTList<arena_ptr<FuncFPAST>> args;
         virtual void to_string(std::string& str, const int tabs=0) const {};
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const { assert(0); };
 };
 
 class InitAST : public BaseAST {
     public:
-        std::optional<std::unique_ptr<ExpAST>> exp = std::nullopt;
-        List<std::unique_ptr<InitAST>> inits;
+        std::optional<arena_ptr<ExpAST>> exp = std::nullopt;
+        ASTList<arena_ptr<InitAST>> inits;
         void try_eval(std::weak_ptr<IRINFO> info, const List<std::optional<unsigned>>& dims);
-        List<std::unique_ptr<ExpAST>> exps;
-        std::string to_ir_string(std::weak_ptr<IRINFO> info);
+        // flattened by try_eval: elements covered, and the written ones by index; the rest are zero
+        unsigned size = 0;
+        ASTList<std::pair<unsigned, arena_ptr<ExpAST>>> exps;
+        arena_ptr<InitIR> to_ir_init(std::weak_ptr<IRINFO> info) const;
         virtual void to_string(std::string& str, const int tabs=0) const {};
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
 
 class DimAST : public BaseAST {
     public:
-        List<std::optional<std::unique_ptr<ExpAST>>> dims;
+        ASTList<std::optional<arena_ptr<ExpAST>>> dims;
         virtual void to_string(std::string &str, const int tabs = 0) const {};
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const { assert(0); };
 };
 
 class StmtsAST : public BaseAST {
     public:
-        List<std::unique_ptr<StmtAST>> stmts;
-        virtual void merge(std::unique_ptr<StmtsAST>& stmts2);
+        ASTList<arena_ptr<StmtAST>> stmts;
+        virtual void merge(arena_ptr<StmtsAST>& stmts2);
         virtual void to_string(std::string &str, const int tabs = 0) const {};
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const { assert(0); };
 };
 
 class StmtExpAST : public StmtAST {
     public:
-        std::unique_ptr<ExpAST> exp;
+        arena_ptr<ExpAST> exp;
         virtual void to_string(std::string &str, const int tabs = 0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
 
 class ReturnAST : public StmtAST {
     public:
-        std::optional<std::unique_ptr<ExpAST>> exp;
+        std::optional<arena_ptr<ExpAST>> exp;
         virtual void to_string(std::string &str, const int tabs = 0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
 
 class AssignAST : public StmtAST {
     public:
-        std::string ident;
-        List<std::unique_ptr<ExpAST>> dims;
-        std::unique_ptr<ExpAST> exp;
+        Symbol ident;
+        ASTList<arena_ptr<ExpAST>> dims;
+        arena_ptr<ExpAST> exp;
         virtual void to_string(std::string &str, const int tabs = 0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
@@ -120,27 +154,27 @@ class AssignAST : public StmtAST {
 class DefAST : public StmtAST {
     public:
         bool is_const = false;
-        std::string ident;
-        std::optional<std::unique_ptr<ExpAST>> exp = std::nullopt;
-        List<std::unique_ptr<ExpAST>> dims;
-        std::optional<std::unique_ptr<InitAST>> init = std::nullopt;
+        Symbol ident;
+        std::optional<arena_ptr<ExpAST>> exp = std::nullopt;
+        ASTList<arena_ptr<ExpAST>> dims;
+        std::optional<arena_ptr<InitAST>> init = std::nullopt;
         virtual void to_string(std::string &str, const int tabs = 0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
 
 class IfAST : public StmtAST {
     public:
-        std::unique_ptr<ExpAST> exp;
-        std::unique_ptr<BlockAST> then_stmt;
-        std::optional<std::unique_ptr<BlockAST>> else_stmt;
+        arena_ptr<ExpAST> exp;
+        arena_ptr<BlockAST> then_stmt;
+        std::optional<arena_ptr<BlockAST>> else_stmt;
         virtual void to_string(std::string &str, const int tabs = 0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
 
 class WhileAST : public StmtAST {
     public:
-        std::unique_ptr<ExpAST> exp;
-        std::unique_ptr<BlockAST> stmt;
+        arena_ptr<ExpAST> exp;
+        arena_ptr<BlockAST> stmt;
         virtual void to_string(std::string &str, const int tabs = 0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
@@ -154,8 +188,11 @@ class ControlAST : public StmtAST {
 
 class CompUnitAST : public BaseAST {
     public:
-        List<std::unique_ptr<DefAST>> var_def;
-        List<std::unique_ptr<FuncDefAST>> func_def;
+        ASTList<arena_ptr<DefAST>> var_def;
+        ASTList<arena_ptr<FuncDefAST>> func_def;
+        // one per function, in order, naming globals by identifier; a local
+        // that shadows a global counts as the global
+        std::vector<GlobalEffects> global_effects() const;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual std::unique_ptr<BaseIR> to_ir(std::weak_ptr<IRINFO> info) const;
 };
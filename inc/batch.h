@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Runs one compile from its command line, without the program name, and
+// returns the exit code. Batch and server mode call it in a forked child per
+// job, so a job that crashes or asserts cannot take the others down, while
+// the static tables are built only once.
+using JobRunner = int (*)(const std::vector<std::string> &args);
+
+// one job per manifest line, '#' starts a comment; returns 1 if any job failed
+extern int run_batch(const char *manifest, unsigned workers, JobRunner run);
+// Reads one line of arguments per connection on a Unix domain socket,
+// sends back what the job prints and then "exit <code>" or "signal <n>".
+// A line may start with --cwd=<dir>, the client's working directory, which
+// relative paths in the job then resolve against as they would in a
+// one-shot compile; without it they resolve against the server's.
+// A connection that sends "shutdown" stops the server.
+extern int run_server(const char *socket_path, unsigned workers, JobRunner run);
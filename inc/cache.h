@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+class CompUnitAST;
+
+// On-disk cache of the text generated for single functions. The key of a
+// function spells out its tokens, the declarations of the globals it names,
+// the return types of the functions it calls and which of those globals they
+// may read or assign, the output mode and the compiler binary, and the line
+// of each statement when the output carries them. Entries are found by a hash
+// of the key and hold the key itself, so a hash collision is only a miss.
+class FunctionCache
+{
+private:
+    std::string dir;
+    std::string prefix;
+    uint64_t max_bytes;
+    bool lines;
+    std::atomic<unsigned> hits{0}, misses{0}, stores{0}, tmp_count{0};
+    std::atomic<uint64_t> stored_bytes{0};
+    unsigned evicted = 0;
+    uint64_t total_bytes = 0;
+    std::string path(const std::string &key) const;
+
+public:
+    FunctionCache(const std::string dir, const std::string mode, uint64_t max_bytes, bool lines = false);
+    bool is_open() const { return !prefix.empty(); }
+    // one key per function of unit, in order; must run before lowering rewrites the tree
+    std::vector<std::string> keys(const CompUnitAST &unit) const;
+    bool load(const std::string &key, std::string &text);
+    void store(const std::string &key, const std::string &text);
+    // drops the least recently used entries until the cache fits in max_bytes;
+    // the directory is only scanned once the recorded size goes past it
+    void evict();
+    void print_stats(std::ostream &out) const;
+};
+
+// non-null only when --cache-dir is given
+extern FunctionCache *function_cache;
@@ -6,12 +6,38 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <stack>
+#include <optional>
 
 #include <riscv.h>
 #include <list.h>
+#include <arena.h>
+#include <symbol.h>
+
+enum class IROP
+{
+    ADD, SUB, MUL, DIV, MOD, AND, OR, XOR, EQ, NE, LT, GT, LE, GE,
+    ALLOC, GLOBAL_ALLOC, LOAD, STORE, GETPTR, GETELEMPTR,
+    CALL_INT, CALL_VOID,
+    BR, JUMP, RET,
+    NOTE,
+    COUNT
+};
+
+struct IROPINFO
+{
+    const char *name;
+    const char *riscv_name;
+    int arity; // -1 for variadic
+    bool binary;
+    bool terminator;
+    bool has_result;
+    bool commutative;
+};
+
+extern const IROPINFO irop_info[static_cast<int>(IROP::COUNT)];
+inline const IROPINFO &get_irop_info(IROP op) { return irop_info[static_cast<int>(op)]; }
+extern IROP irop_from_name(const std::string &name);
 
-extern const std::unordered_set<std::string> op_name;
-extern const std::unordered_set<std::string> end_of_block;
 extern const std::unordered_map<std::string, std::string> lib_func_type;
 extern const std::unordered_map<std::string, std::string> lib_func_decl;
 
@@ -29,10 +55,39 @@ class BaseIR {
         virtual void print_super() = 0;
 };
 
+// operands live in the same pool as the instruction
+using IRArgs = std::vector<Symbol, ArenaAllocator<Symbol>>;
+
+// stands in the operand list for the instruction's aggregate initializer
+extern const Symbol init_sym;
+
+// flattened array initializer; elements not listed are zero, listed ones
+// without a value are undef (a local element computed at run time)
+using InitValues = std::vector<std::pair<unsigned, std::optional<Symbol>>, ArenaAllocator<std::pair<unsigned, std::optional<Symbol>>>>;
+
+struct InitIR {
+    InitIR(Arena &pool, unsigned size) : size(size), values(InitValues::allocator_type(&pool)) {}
+    unsigned size;
+    InitValues values;
+    void to_string(std::string& str) const;
+};
+
+// values a jump or br passes to the parameters of its targets; a jump uses
+// args[0], a br args[0] for its true target and args[1] for its false one
+struct EdgeArgs {
+    EdgeArgs(Arena &pool) : args{IRArgs(ArenaAllocator<Symbol>(&pool)), IRArgs(ArenaAllocator<Symbol>(&pool))} {}
+    IRArgs args[2];
+};
+
 class ValueIR : public BaseIR {
     public:
-        std::string op;
-        std::vector<std::string> args;
+        ValueIR(Arena &pool, IROP op) : op(op), args(ArenaAllocator<Symbol>(&pool)) {}
+        IROP op;
+        // source line of the statement the instruction came from, 0 if none
+        unsigned line = 0;
+        IRArgs args;
+        arena_ptr<InitIR> init;
+        arena_ptr<EdgeArgs> edge_args;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual void to_riscv(RISCV &riscv, Controller &cont);
         virtual void gather_super() {}
@@ -42,8 +97,8 @@ class ValueIR : public BaseIR {
 
 class BlockIR : public BaseIR {
     public:
-        std::string name;
-        std::unordered_map<std::string, unsigned> count;
+        Symbol name;
+        std::unordered_map<Symbol, unsigned> count;
         virtual void to_string(std::string& str, const int tabs=0) const = 0;
         virtual void to_riscv(RISCV &riscv, Controller &cont) = 0;
         virtual void gather_super() {}
@@ -51,43 +106,104 @@ class BlockIR : public BaseIR {
 
 class BaseBlockIR : public BlockIR {
     public:
-        List<std::unique_ptr<ValueIR>> values;
+        // block parameters, all i32; the entry block has none
+        std::vector<Symbol> params;
+        List<arena_ptr<ValueIR>> values;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual void to_riscv(RISCV &riscv, Controller &cont);
         virtual void alloc_preserve(bool in_while=true);
         virtual void print_super() {}
 };
 
+// Control-flow graph of one function. Blocks are numbered densely in the
+// order of FunctionIR::base_blocks, so the entry block is 0.
+struct CFG {
+    static constexpr unsigned NONE = ~0u;
+    std::vector<BaseBlockIR *> blocks;
+    std::vector<std::vector<unsigned>> succs, preds;
+    // the blocks reachable from the entry, in reverse post-order
+    std::vector<unsigned> rpo;
+    // for the header of a while loop its exit block, NONE elsewhere
+    std::vector<unsigned> loop_exit;
+    std::vector<bool> is_loop_exit;
+    std::unordered_map<Symbol, unsigned> ids;
+    // filled by build_dominators: immediate dominators (NONE for unreachable
+    // blocks), the dominator tree and the dominance frontiers
+    std::vector<unsigned> idom;
+    std::vector<std::vector<unsigned>> dom_children, frontier;
+    // filled by FunctionIR::compute_liveness: the values live out of each
+    // block, and the values each block reads as (instruction index, value)
+    std::vector<std::vector<Symbol>> live_out;
+    std::vector<std::vector<std::pair<unsigned, Symbol>>> reads;
+    void build(const List<arena_ptr<BaseBlockIR>> &base_blocks, const std::vector<std::pair<Symbol, Symbol>> &loops);
+    // drops the blocks not kept; what is kept but not reachable loses its
+    // edges and loops, as if it returned
+    void retain(const std::vector<bool> &keep);
+    void build_dominators();
+    void clear();
+    unsigned id(const Symbol name) const { return ids.at(name); }
+    bool is_loop_header(const Symbol name) const { return loop_exit[id(name)] != NONE; }
+};
+
 class SuperBlockIR : public BlockIR {
     public:
-        List<std::unique_ptr<BlockIR>> base_blocks;
-        std::unordered_set<std::string> preserve;
+        List<arena_ptr<BlockIR>> base_blocks;
+        // the block control leaves the loop through; unset for the whole function
+        std::optional<Symbol> exit;
+        std::vector<Symbol> preserve;
+        // the scalar globals assigned in it, found by preserve_globals
+        std::unordered_set<Symbol> written;
         virtual void to_string(std::string& str, const int tabs=0) const {};
         virtual void to_riscv(RISCV &riscv, Controller &cont);
         virtual void alloc_preserve(bool in_while=true);
         virtual void print_super();
+        // under linear scan: preserves the scalar globals each loop accesses
+        // most, at most limit, counting the accesses of each in count and
+        // noting those assigned in written
+        void preserve_globals(const std::unordered_set<Symbol> &globals, unsigned limit);
 };
 
 class FunctionIR : public BaseIR {
     public:
+        // holds every instruction and block of the function until to_riscv is done
+        std::unique_ptr<Arena> pool;
         FuncRISCVINFO func_riscv_info;
         std::string name;
         std::string return_type;
         std::vector<std::string> args;
-        List<std::unique_ptr<BaseBlockIR>> base_blocks;
-        std::unique_ptr<SuperBlockIR> super_block;
+        List<arena_ptr<BaseBlockIR>> base_blocks;
+        CFG cfg;
+        arena_ptr<SuperBlockIR> super_block;
+        // output taken from the function cache; such a function has no blocks
+        std::optional<std::string> cached;
+        // the function's key in the function cache, empty when caching is off
+        std::string cache_key;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual void to_riscv(RISCV &riscv, Controller &cont);
         virtual void gather_super();
         virtual void alloc_preserve(bool in_while=true);
         virtual void print_super();
+        // registers the linear-scan allocator gave to values for their whole
+        // life; empty under the LRU allocator
+        std::vector<std::pair<Symbol, int>> pinned;
+        // promotes scalar allocs to SSA values and block parameters
+        void mem2reg();
+        void allocate_registers();
+        void compute_liveness();
+        // keeps the scalar globals its loops use in the saved registers the
+        // allocator left over, where calls that do not touch them keep them
+        void preserve_globals(const std::unordered_set<Symbol> &globals);
 };
 
+// whether functions are put into SSA form by FunctionIR::mem2reg
+extern bool mem2reg_enabled;
+
 class ProgramIR : public BaseIR {
     public:
         GlobRISCVINFO global_riscv_info;
         std::shared_ptr<IRINFO> program_info;
-        std::vector<std::unique_ptr<ValueIR>> values;
+        std::unique_ptr<Arena> pool;
+        std::vector<arena_ptr<ValueIR>> values;
         std::vector<std::unique_ptr<FunctionIR>> functions;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual void to_riscv(RISCV &riscv, Controller &cont);
@@ -98,59 +214,90 @@ class ProgramIR : public BaseIR {
 
 class PartIR : public BaseIR {
     private:
-        List<std::unique_ptr<ValueIR>> values;
-        std::optional<std::pair<List<std::unique_ptr<ValueIR>>, std::string>> new_values = std::nullopt;
+        List<arena_ptr<ValueIR>> values;
+        std::optional<std::pair<List<arena_ptr<ValueIR>>, Symbol>> new_values = std::nullopt;
+        // break/continue jumps not yet bound to a loop; the innermost enclosing
+        // WhileAST patches them, so no loop rescans the instructions of its body
+        std::vector<ValueIR *> breaks, continues;
     public:
         void seal_next(std::weak_ptr<IRINFO> info);
-        List<std::unique_ptr<BaseBlockIR>> blocks;
+        List<arena_ptr<BaseBlockIR>> blocks;
         virtual void to_string(std::string& str, const int tabs=0) const;
         virtual void to_riscv(RISCV &riscv, Controller &cont) {};
         void merge(std::unique_ptr<PartIR>& part, std::weak_ptr<IRINFO> info);
-        void append(std::unique_ptr<ValueIR> value, std::weak_ptr<IRINFO> info);
-        void append(const std::vector<std::string> args, std::weak_ptr<IRINFO> info);
-        void seal_prev(const std::string name, const std::string type);
-        void create_new_block(const std::string name);
-        void substitute(const std::string& name1, const std::string& name2);
-        List<std::unique_ptr<ValueIR>>& get_values() { return values; };
+        void append(arena_ptr<ValueIR> value, std::weak_ptr<IRINFO> info);
+        void append(IROP op, const std::vector<Symbol> args, std::weak_ptr<IRINFO> info);
+        void seal_prev(const Symbol name, const std::string type, std::weak_ptr<IRINFO> info);
+        void create_new_block(const Symbol name);
+        void append_control(const std::string &type, std::weak_ptr<IRINFO> info);
+        void patch_controls(const Symbol continue_name, const Symbol break_name);
+        List<arena_ptr<ValueIR>>& get_values() { return values; };
         virtual void gather_super() {}
         virtual void alloc_preserve(bool in_while=true) {}
         virtual void print_super() {}
 };
 
+// one definition of a source variable, i.e. @name_N
+struct PVARINFO {
+    Symbol name;
+    std::optional<Symbol> const_value;
+    unsigned level;
+    bool is_arg;
+    std::vector<std::optional<unsigned>> type;
+};
+
+// every definition of one source name; stack holds the visible ones, innermost last
+struct PVARSYM {
+    std::vector<PVARINFO> defs;
+    std::vector<unsigned> stack;
+};
+
 class IRINFO {
     private:
-        int level, time;
+        int level;
         std::unordered_map<std::string, unsigned> label_count;
         std::unordered_map<std::string, unsigned> tvar_count;
-        std::unordered_map<std::string, unsigned> tvar_last_count;
-        std::unordered_map<std::string, unsigned> tvar_time;
-        std::unordered_map<std::string, unsigned> pvar_count;
-        std::unordered_map<std::string, std::unordered_set<unsigned>> pvar_alloc;
-        std::unordered_map<std::string, std::stack<unsigned>> pvar_stack;
-        std::unordered_map<std::string, std::unordered_map<unsigned, std::optional<std::string>>> pvar_const;
-        std::unordered_map<std::string, std::unordered_map<unsigned, unsigned>> pvar_level;
-        std::unordered_map<std::string, std::unordered_map<unsigned, bool>> pvar_is_arg;
-        std::unordered_map<std::string, std::unordered_map<unsigned, List<std::optional<unsigned>>>> pvar_type;
-        std::unordered_map<std::string, std::string> func_type;
+        // temporaries of the current function in allocation order
+        std::vector<Symbol> tvars;
+        // indexed by the identifier's symbol
+        std::vector<PVARSYM> pvars;
+        // definitions made in the current function, in order
+        std::vector<std::pair<Symbol, unsigned>> pvar_alloc;
+        // identifiers pushed since each open scope began, undone by dec_level
+        std::vector<Symbol> scope_log;
+        std::vector<size_t> scope_marks;
+        std::unordered_map<Symbol, std::string> func_type;
+        std::unique_ptr<Arena> pool;
     public:
         IRINFO();
         virtual ~IRINFO() = default;
-        std::string last_result;
+        // the global scope and function signatures, for lowering functions on their own
+        std::shared_ptr<IRINFO> fork() const;
+        Symbol last_result;
         std::string current_state;
         std::string func_name;
-        std::string get_var_name(const std::string ast_name) const;
-        std::string allocate_var(const std::string info, const bool temp=true, const bool var=false, const bool is_arg=false, const List<std::optional<unsigned>> dims={});
-        std::string allocate_label(const std::string info);
-        void set_const(const std::string& name, const std::string& value);
-        std::optional<std::string> get_const(const std::string& name) const;
+        // while loops of the current function as (condition block, exit block)
+        std::vector<std::pair<Symbol, Symbol>> loops;
+        // source line of the statement being lowered, given to every new value
+        unsigned line = 0;
+        Arena& get_pool() { return *pool; }
+        std::unique_ptr<Arena> take_pool();
+        arena_ptr<ValueIR> new_value(IROP op) const;
+        Symbol get_var_name(const Symbol ident) const;
+        Symbol allocate_var(const std::string info, const bool temp=true);
+        Symbol define_var(const Symbol ident, const bool is_arg=false, const List<std::optional<unsigned>> dims={});
+        Symbol allocate_label(const std::string info);
+        const PVARINFO& lookup(const Symbol ident) const;
+        void set_const(const Symbol ident, const Symbol value);
+        std::optional<Symbol> get_const(const Symbol ident) const;
         std::unique_ptr<PartIR> get_alloc(std::weak_ptr<IRINFO> info) const;
-        void set_func(const std::string& name, const std::string& type);
-        std::string get_func(const std::string& name) const;
-        std::vector<std::optional<unsigned>> get_type(const std::string& name) const;
-        bool is_arg(const std::string& name) const;
+        void set_func(const Symbol name, const std::string& type);
+        std::string get_func(const Symbol name) const;
+        std::vector<std::optional<unsigned>> get_type(const Symbol ident) const;
+        bool is_arg(const Symbol ident) const;
         void inc_level();
         void dec_level();
-        std::unique_ptr<PartIR> start_func(const List<std::pair<std::string, List<std::optional<unsigned>>>>& args, std::vector<std::string>& result, std::weak_ptr<IRINFO> info);
+        std::unique_ptr<PartIR> start_func(const List<std::pair<Symbol, List<std::optional<unsigned>>>>& args, std::vector<std::string>& result, std::weak_ptr<IRINFO> info);
         void end_func();
 };
 
@@ -2,15 +2,15 @@
 
 #include <list>
 
-template <typename T>
-class List : public std::list<T>
+template <typename T, typename Alloc = std::allocator<T>>
+class List : public std::list<T, Alloc>
 {
 public:
-    virtual void merge(List<T>&& other)
+    virtual void merge(List<T, Alloc>&& other)
     {
         this->splice(this->end(), other);
     };
-    virtual void merge(List<T>& other)
+    virtual void merge(List<T, Alloc>& other)
     {
         this->splice(this->end(), other);
     };
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+
+enum class LogLevel
+{
+    SILENT,
+    ERROR,
+    WARN,
+    INFO,
+    DEBUG
+};
+
+extern LogLevel log_level;
+
+// set by --log-level=<name>, returns false on unknown names
+extern bool set_log_level(const std::string name);
+inline bool log_enabled(LogLevel level) { return level != LogLevel::SILENT && level <= log_level; }
+// messages go to stderr, or are dropped when the level is not enabled
+extern std::ostream &logger(LogLevel level);
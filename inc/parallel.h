@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+
+// number of threads generating code, set by -j
+extern unsigned codegen_jobs;
+
+// threads parallel_for uses for n tasks, at least 1
+extern unsigned parallel_workers(size_t n);
+// runs task(i, worker) for every i below n; worker is below parallel_workers(n)
+// and no two tasks with the same worker run at once. With one worker
+// everything runs in order on the calling thread.
+extern void parallel_for(size_t n, const std::function<void(size_t, unsigned)> &task);
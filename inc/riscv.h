@@ -7,19 +7,31 @@
 #include <list>
 #include <unordered_map>
 #include <unordered_set>
+#include <optional>
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
 
 #include <list.h>
 #include <str.h>
+#include <log.h>
+#include <symbol.h>
+#include <parallel.h>
 
 #define IMM12_MAX 2048
 #define REG_NUM 32
 #define FREE_REG_NUM 13
 #define SAVED_REG_NUM 12
+// the caller's fp is saved just below the saved registers
+#define FP_SAVE_POS (4 * SAVED_REG_NUM + 4)
 #define ZERO_REG 0
 #define A0_REG 10
 #define T0_REG 5
 #define T5_REG 30
 #define T6_REG 31
+#define EMIT_BUFFER_SIZE (1 << 16)
+// local array initializers up to this many elements are stored one by one
+#define INIT_UNROLL_MAX 16
 
 extern const std::string reg_names[REG_NUM];
 extern const int free_regs[FREE_REG_NUM];
@@ -27,24 +39,72 @@ extern const int saved_regs[SAVED_REG_NUM];
 
 extern int regname_to_idx(const std::string name);
 
+// operands that stand for a scratch register rather than a variable
+extern const Symbol t6_sym;
+extern const Symbol zero_sym;
+
+// what the assembly carries besides the code: nothing, each IR instruction
+// as a comment, or .loc directives mapping it back to source lines
+enum class Annotation { NONE, IR, SOURCE };
+extern Annotation annotation;
+// the input file .file names when annotating source lines
+extern std::string annotation_file;
+// whether each stack slot load and store of a variable is led by a
+// "# spill" line, so a simulator can count them as they run
+extern bool mark_spills;
+
+// how values get registers: each its own for the whole function where live
+// ranges allow (FunctionIR::allocate_registers), or only while the
+// Controller caches it between jumps and calls
+enum class RegAlloc { LRU, LINEAR };
+extern RegAlloc reg_alloc;
+
+// the variable a function argument is stored in, from its "name: type"
+extern Symbol transform_arg_name(const std::string name);
+
+struct CFG;
+
 class RISCV
 {
+private:
+    std::ostream *out;
+    std::ostream *echo = nullptr;
+    std::string buffer;
+
 public:
+    // only the instructions not yet emitted, i.e. the function being generated
     List<std::vector<std::string>> text;
-    ~RISCV() = default;
+    RISCV(std::ostream &out) : out(&out) {}
+    // keeps everything emitted in memory until take()
+    RISCV() : out(nullptr) {}
+    ~RISCV() { flush(); }
+    void set_echo(std::ostream &echo) { this->echo = &echo; }
     void to_string(std::string &str) const;
+    void emit();
+    void write(const std::string &str);
+    void flush();
+    std::string take() { return std::move(buffer); }
 };
 
 extern void safe_mem(const std::string op, const std::string reg_name, const int loc, RISCV &riscv, const std::string base = "fp");
 
+// the globals a function may read and may assign, itself or through the
+// functions it calls, each sorted
+struct GlobalEffects
+{
+    std::vector<Symbol> reads, writes;
+};
+
 class GlobRISCVINFO
 {
 private:
     friend class Controller;
 
 public:
-    std::unordered_map<std::string, std::string> global_var;
-    std::unordered_map<std::string, std::string> func_name;
+    SymbolMap<std::string> global_var;
+    SymbolMap<std::string> func_name;
+    // by function, in IR names; library functions touch no globals and have none
+    SymbolMap<GlobalEffects> effects;
     ~GlobRISCVINFO() = default;
 };
 
@@ -52,48 +112,156 @@ class FuncRISCVINFO
 {
 private:
     int mem_need;
-    std::unordered_map<std::string, int> save_pos;
+    // bytes at the bottom of the frame where callees taking at most eight
+    // arguments spill them
+    int out_args;
+    std::unordered_map<Symbol, int> save_pos;
     friend class Controller;
 
 public:
     void init_save_reg();
     int get_mem_need() const { return mem_need; }
-    int get_save_pos(const std::string name) const {if(!save_pos.count(name)) std::cout<<name<<std::endl; return save_pos.at(name); }
+    int get_out_args() const { return out_args; }
+    int get_save_pos(const Symbol name) const {if(!save_pos.count(name)) logger(LogLevel::ERROR)<<"no save position for "<<symbol_name(name)<<std::endl; return save_pos.at(name); }
     ~FuncRISCVINFO() = default;
 };
 
+// variables held in callee-saved registers; a handful of entries, kept in insertion order
+class SaveMap
+{
+private:
+    std::vector<std::pair<Symbol, unsigned>> entries;
+
+public:
+    bool count(const Symbol name) const
+    {
+        for (auto const &entry : entries)
+            if (entry.first == name)
+                return true;
+        return false;
+    }
+    unsigned at(const Symbol name) const
+    {
+        for (auto const &entry : entries)
+            if (entry.first == name)
+                return entry.second;
+        // callers check count() first; NDEBUG must not fall off the end
+        assert(0);
+        std::abort();
+    }
+    void insert(const std::pair<Symbol, unsigned> &entry)
+    {
+        if (!count(entry.first))
+            entries.push_back(entry);
+    }
+    void clear() { entries.clear(); }
+    std::vector<std::pair<Symbol, unsigned>>::const_iterator begin() const { return entries.begin(); }
+    std::vector<std::pair<Symbol, unsigned>>::const_iterator end() const { return entries.end(); }
+};
+
 class Controller
 {
 private:
     GlobRISCVINFO *glob = nullptr;
     FuncRISCVINFO *func = nullptr;
-    std::optional<std::string> reg_in_use[32];
-    std::unordered_map<std::string, std::optional<int>> reg_pos;
-    std::unordered_set<std::string> label_set;
+    const CFG *cfg = nullptr;
+    std::optional<Symbol> reg_in_use[32];
+    SymbolMap<std::optional<int>> reg_pos;
+    std::unordered_set<Symbol> label_set;
+    std::string func_name;
+    int label_count;
+    unsigned loc_line;
     int current_time;
     int last_used[REG_NUM];
+    SymbolMap<int> pinned;
+    // registers some pinned value holds, out of the LRU pool for the function
+    bool reserved[REG_NUM];
+    // indices into saved_regs of the pinned saved registers, restored on return
+    std::vector<int> pinned_saved;
+    // whether a register holds a newer value than the stack slot of its variable
+    bool dirty[REG_NUM];
+    // liveness at the current instruction: the values live out of its block,
+    // the last instruction of the block reading each value, its index, and
+    // whether it is done reading its operands
+    SymbolMap<bool> live_out;
+    SymbolMap<unsigned> last_read;
+    unsigned position;
+    bool operands_read;
+    unsigned current_block;
+    // the variables each block ended with in the free registers, for a
+    // successor it alone leads to; dirty ones the block left to it to store
+    struct LeftInReg
+    {
+        int reg;
+        Symbol name;
+        bool dirty;
+    };
+    std::unordered_map<unsigned, std::vector<LeftInReg>> left_in_regs;
     int find_lru();
     int find_reg(RISCV &riscv);
+    bool needs_store(int reg) const;
 
 public:
-    std::unordered_map<std::string, unsigned> current_save;
-    int long_jump = 0;
-    std::unordered_set<std::string> ptr;
+    SaveMap current_save;
+    // read-only data of the current function, placed after its code
+    List<std::vector<std::string>> rodata;
+    SymbolMap<bool> ptr;
+    // loads and stores of stack slots emitted for variables, over all functions
+    unsigned spill_loads = 0, spill_stores = 0;
     void clear(const std::vector<std::string>& args);
-    void refresh(RISCV &riscv, bool save = true, std::vector<std::string> except = {});
-    void transition(RISCV &riscv, std::string mode);
-    void alloc(const std::string name, RISCV &riscv, bool reg = true, int size = 4);
-    int load(const std::string name, RISCV &riscv, bool load = true, int specify = 0);
-    void try_invalidate(const std::string name);
-    void var_mem(const std::string op, const std::string name, const std::string reg_name, RISCV &riscv);
-    void bind(const std::string reg, const std::string name);
+    void refresh(RISCV &riscv, bool save = true, std::vector<Symbol> except = {});
+    // stores the globals kept in saved registers that the callee may use,
+    // or loads those it may assign
+    void transition(RISCV &riscv, std::string mode, const Symbol callee);
+    void alloc(const Symbol name, RISCV &riscv, bool reg = true, int size = 4);
+    int load(const Symbol name, RISCV &riscv, bool load = true, int specify = 0);
+    void try_invalidate(const Symbol name);
+    void var_mem(const std::string op, const Symbol name, const std::string reg_name, RISCV &riscv);
+    void bind(const std::string reg, const Symbol name);
     void save_back(int reg, RISCV &riscv, bool sync=false);
+    int borrow(RISCV &riscv);
+    void give_back(int reg);
     void set_glob(GlobRISCVINFO *glob) { this->glob = glob; }
-    void set_func(FuncRISCVINFO *func, const std::vector<std::string>& args) { this->func = func, clear(args); }
-    void checkout(std::unordered_map<std::string, unsigned>& new_set, RISCV &riscv, bool load=true);
+    void set_func(FuncRISCVINFO *func, const std::string name, const std::vector<std::string>& args) { this->func = func, func_name = name, clear(args); }
+    void set_cfg(const CFG *cfg) { this->cfg = cfg; }
+    const CFG &get_cfg() const { return *cfg; }
+    // puts new_set in the saved registers; what is new there is taken as
+    // newer than memory, what stays keeps its state
+    void checkout(const SaveMap& new_set, RISCV &riscv, bool load=true);
+    // a value loaded in a saved register that nothing assigns until it leaves
+    void mark_clean(const Symbol name) { dirty[current_save.at(name)] = false; }
+    // starts a block, or code run right before it; stores of values it
+    // does not read again are dropped from then on
+    void enter_block(unsigned block);
+    // notes what the free registers hold at the end of the current block;
+    // call before the refresh of a terminator that moves no block arguments
+    void leave_block();
+    // keeps the values the only predecessor of block left in the registers
+    // instead of loading them again; block is entered from nowhere else
+    void inherit(unsigned block, RISCV &riscv);
+    void advance() { position++, operands_read = false; }
+    // values the current instruction reads last are dead from here on
+    void done_reading() { operands_read = true; }
+    // gives the values their registers for the whole function, after the
+    // prologue: saves the saved registers used and moves the arguments in
+    void pin(const std::vector<std::pair<Symbol, int>> &assignment, RISCV &riscv);
+    int pinned_reg(const Symbol name) const { return pinned.count(name) ? pinned.at(name) : -1; }
+    bool is_reserved(int reg) const { return reserved[reg]; }
     void prepare_return(RISCV &riscv);
-    bool has_set_label(std::string label) const;
-    void set_label(std::string label);
+    // on the code of the function: drops jumps to the next instruction, and
+    // lets a conditional branch over a jump take the jump's target instead;
+    // branches beyond the 4 KiB reach then go through a jump
+    void relax_branches(RISCV &riscv);
+    // emits .loc when the source line changes
+    void mark_line(unsigned line, RISCV &riscv);
+    bool has_set_label(const Symbol label) const;
+    void set_label(const Symbol label);
+    // labels made up during lowering carry the function name, so functions
+    // can be lowered on their own and still not clash
+    std::string new_label(const std::string kind) { return kind + "_" + func_name + "_" + std::to_string(label_count++); }
+    // IR block labels are only unique within their function
+    std::string block_label(const std::string name) const { return func_name + "." + name; }
     const GlobRISCVINFO *get_glob() const { return glob; }
     const FuncRISCVINFO *get_func() const { return func; }
+    void reserve_out_args(int size) { func->out_args = std::max(func->out_args, size); }
 };
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+// The whole input file in one buffer followed by the two NUL bytes that
+// yy_scan_buffer needs. The file is mapped when the tail of its last page
+// has room for them, and read with a single read() loop otherwise.
+class SourceBuffer
+{
+private:
+    char *data = nullptr;
+    size_t size = 0;
+    size_t mapped_size = 0;
+    bool mapped = false;
+
+public:
+    SourceBuffer() = default;
+    SourceBuffer(const SourceBuffer &) = delete;
+    SourceBuffer &operator=(const SourceBuffer &) = delete;
+    ~SourceBuffer() { close(); }
+    bool open(const std::string path);
+    void close();
+    bool is_mapped() const { return mapped; }
+    const char *get_text() const { return data; }
+    size_t get_size() const { return size; }
+    // buffer and length to hand to yy_scan_buffer, terminators included
+    char *get_lex_base() { return data; }
+    size_t get_lex_size() const { return size + 2; }
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Identifiers, IR value names, labels and constant operands are interned
+// once; everything past the lexer passes the 32-bit id around and only
+// looks the spelling up when printing. Interning is safe from several
+// threads at once.
+using Symbol = uint32_t;
+
+struct SymbolInfo
+{
+    std::string name;
+    bool is_num;      // same test as is_num() in str.h
+    bool is_var;      // starts with % or @
+    bool is_allocvar; // @name or %alloc_*
+    int num;          // value when is_num
+};
+
+extern Symbol intern(std::string_view name);
+extern const SymbolInfo &symbol_info(Symbol sym);
+inline const std::string &symbol_name(Symbol sym) { return symbol_info(sym).name; }
+
+// Dense map indexed by Symbol. clear() is O(1): entries written before the
+// last clear() are ignored, so per-function tables can be reset cheaply.
+template <typename T>
+class SymbolMap
+{
+private:
+    std::vector<std::pair<unsigned, T>> slots;
+    unsigned epoch = 1;
+
+public:
+    bool count(Symbol sym) const { return sym < slots.size() && slots[sym].first == epoch; }
+    const T &at(Symbol sym) const { return slots.at(count(sym) ? sym : slots.size()).second; }
+    T &operator[](Symbol sym)
+    {
+        if (sym >= slots.size())
+            slots.resize(sym + sym / 2 + 16);
+        if (slots[sym].first != epoch)
+            slots[sym] = {epoch, T()};
+        return slots[sym].second;
+    }
+    void erase(Symbol sym)
+    {
+        if (count(sym))
+            slots[sym].first = 0;
+    }
+    void clear() { epoch++; }
+};
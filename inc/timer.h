@@ -0,0 +1,66 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// cpu is the calling thread's CPU time, process_cpu that of all threads
+struct TimeSample
+{
+    double wall = 0, cpu = 0, process_cpu = 0;
+    long peak_rss = 0;
+    static TimeSample now();
+};
+
+struct TimeRecord
+{
+    std::string name;
+    double wall = 0, cpu = 0;
+    long rss_delta = 0;
+    unsigned calls = 0;
+    void add(const TimeSample &start, const TimeSample &end);
+};
+
+struct PhaseRecord : TimeRecord
+{
+    std::vector<TimeRecord> functions;
+    // index into functions by name, as threads finish functions in any order
+    std::unordered_map<std::string, size_t> function_index;
+};
+
+class TimeReport
+{
+private:
+    std::vector<PhaseRecord> phases;
+    TimeSample start;
+
+public:
+    TimeReport() : start(TimeSample::now()) {}
+    PhaseRecord &get_phase(const std::string name);
+    void print_text(std::ostream &out) const;
+    void print_json(std::ostream &out) const;
+};
+
+// non-null only when --time-report is given
+extern TimeReport *time_report;
+
+// Times the enclosing scope into phase, or into the phase's entry for
+// function when one is given. Does nothing without --time-report. The CPU
+// time is the current thread's, so under -j a phase that waits for the
+// workers counts only its own thread; theirs is in the function entries.
+class PhaseTimer
+{
+private:
+    const char *phase;
+    const std::string *function;
+    TimeSample start;
+
+public:
+    PhaseTimer(const char *phase, const std::string *function = nullptr) : phase(phase), function(function)
+    {
+        if (time_report)
+            start = TimeSample::now();
+    }
+    ~PhaseTimer();
+};
@@ -0,0 +1,33 @@
+#include <arena.h>
+#include <algorithm>
+
+void *Arena::allocate(size_t size, size_t align)
+{
+    size_t pad = (align - reinterpret_cast<size_t>(cur) % align) % align;
+    if (pad + size > left)
+    {
+        size_t chunk_size = std::max(CHUNK_SIZE, size + align);
+        chunks.push_back(std::unique_ptr<char[]>(new char[chunk_size]));
+        cur = chunks.back().get();
+        left = chunk_size;
+        pad = (align - reinterpret_cast<size_t>(cur) % align) % align;
+    }
+    void *result = cur + pad;
+    cur += pad + size;
+    left -= pad + size;
+    bytes += size;
+    return result;
+}
+
+void Arena::reset()
+{
+    for (DtorNode *node = last_dtor; node; node = node->prev)
+        node->dtor(node + 1);
+    last_dtor = nullptr;
+    children.clear();
+    chunks.clear();
+    cur = nullptr;
+    left = 0;
+    bytes = 0;
+    objects = 0;
+}
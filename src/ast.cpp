@@ -1,47 +1,53 @@
 #include <ast.h>
 #include <str.h>
+#include <timer.h>
+#include <parallel.h>
+#include <cache.h>
+#include <algorithm>
 #include <iostream>
+#include <unordered_set>
 #include <cassert>
 
-std::string value_exp_to_ir(const std::unique_ptr<ExpAST>& exp, std::unique_ptr<PartIR>& part_ir, std::weak_ptr<IRINFO> info)
+Arena ast_arena;
+thread_local Arena *local_ast_arena = nullptr;
+
+Symbol value_exp_to_ir(const arena_ptr<ExpAST>& exp, std::unique_ptr<PartIR>& part_ir, std::weak_ptr<IRINFO> info)
 {
     assert(exp->value.has_value());
-    if (is_num(exp->value.value()))
-        return exp->value.value();
+    Symbol value = exp->value.value();
+    if (symbol_info(value).is_num)
+        return value;
     else
     {
-        std::string name = info.lock()->get_var_name(exp->value.value());
-        if (info.lock()->get_const(name).has_value())
-            return info.lock()->get_const(name).value();
-        else if (!info.lock()->get_type(name).empty())
+        auto& def = info.lock()->lookup(value);
+        if (def.const_value.has_value())
+            return def.const_value.value();
+        else if (!def.type.empty())
         {
-            std::string op = info.lock()->is_arg(name) ? "getptr" :"getelemptr";
-            std::string ret_name = info.lock()->allocate_var(op);
-            part_ir->append({op, ret_name, name, "0"}, info);
+            IROP op = info.lock()->is_arg(value) ? IROP::GETPTR : IROP::GETELEMPTR;
+            Symbol ret_name = info.lock()->allocate_var(get_irop_info(op).name);
+            part_ir->append(op, {ret_name, def.name, intern("0")}, info);
             return ret_name;
         }
-        else if (is_allocvar(name))
+        else
         {
-            if (info.lock()->is_arg(name))
-                return name;
-            std::string tname = info.lock()->allocate_var("load");
-            part_ir->append({"load", tname, name}, info);
+            if (info.lock()->is_arg(value))
+                return def.name;
+            Symbol tname = info.lock()->allocate_var("load");
+            part_ir->append(IROP::LOAD, {tname, def.name}, info);
             return tname;
         }
-        else
-            return name;
     }
 }
 
-std::optional<std::string> try_cal_str_value(const std::string &str, std::weak_ptr<IRINFO> info)
+std::optional<Symbol> try_cal_str_value(const Symbol value, std::weak_ptr<IRINFO> info)
 {
-    if (is_num(str))
-        return str;
-    std::string name = info.lock()->get_var_name(str);
-    return info.lock()->get_const(name);
+    if (symbol_info(value).is_num)
+        return value;
+    return info.lock()->get_const(value);
 }
 
-std::optional<std::string> try_cal_value_exp(const std::unique_ptr<ExpAST> &exp, std::weak_ptr<IRINFO> info)
+std::optional<Symbol> try_cal_value_exp(const arena_ptr<ExpAST> &exp, std::weak_ptr<IRINFO> info)
 {
     return try_cal_str_value(exp->value.value(), info);
 }
@@ -52,98 +58,103 @@ void PartIR::merge(std::unique_ptr<PartIR> &part, std::weak_ptr<IRINFO> info)
     if (new_values.has_value())
     {
         new_values.value().first.merge(part->values);
-        if (!new_values.value().first.empty() && end_of_block.count(new_values.value().first.rbegin()->get()->op))
+        if (!new_values.value().first.empty() && get_irop_info(new_values.value().first.rbegin()->get()->op).terminator)
             seal_next(info);
     }
     else
-        if (values.empty() || !end_of_block.count(values.rbegin()->get()->op))
+        if (values.empty() || !get_irop_info(values.rbegin()->get()->op).terminator)
             values.merge(part->values);
+        else if (!part->breaks.empty() || !part->continues.empty())
+        {
+            // unreachable code is dropped along with part, and so are its jumps
+            std::unordered_set<ValueIR *> dropped;
+            for (auto &value : part->values)
+                dropped.insert(value.get());
+            auto is_dropped = [&](ValueIR *value) { return dropped.count(value) != 0; };
+            part->breaks.erase(std::remove_if(part->breaks.begin(), part->breaks.end(), is_dropped), part->breaks.end());
+            part->continues.erase(std::remove_if(part->continues.begin(), part->continues.end(), is_dropped), part->continues.end());
+        }
     if (part->new_values.has_value())
         new_values = std::make_pair(std::move(part->new_values.value().first), std::move(part->new_values.value().second));
+    breaks.insert(breaks.end(), part->breaks.begin(), part->breaks.end());
+    continues.insert(continues.end(), part->continues.begin(), part->continues.end());
 }
 
 void PartIR::seal_next(std::weak_ptr<IRINFO> info)
 {
     if (!new_values.has_value())
         return;
-    auto next_block = std::make_unique<BaseBlockIR>();
+    auto next_block = make_arena<BaseBlockIR>(info.lock()->get_pool());
     next_block->name = new_values.value().second;
     next_block->values.merge(new_values.value().first);
-    if (next_block->values.empty() || !end_of_block.count(next_block->values.rbegin()->get()->op))
+    if (next_block->values.empty() || !get_irop_info(next_block->values.rbegin()->get()->op).terminator)
     {
-        auto ret = std::make_unique<ValueIR>();
-        ret->op = "jump";
-        ret->args = {"\%labelexit_" + info.lock()->func_name};
+        auto ret = info.lock()->new_value(IROP::JUMP);
+        ret->args = {intern("\%labelexit_" + info.lock()->func_name)};
         next_block->values.push_back(std::move(ret));
     }
     blocks.push_back(std::move(next_block));
     new_values = std::nullopt;
 }
 
-void PartIR::append(std::unique_ptr<ValueIR> value, std::weak_ptr<IRINFO> info)
+void PartIR::append(arena_ptr<ValueIR> value, std::weak_ptr<IRINFO> info)
 {
-    std::string op = value->op;
+    IROP op = value->op;
     if (new_values.has_value())
     {
         new_values.value().first.push_back(std::move(value));
-        if (end_of_block.count(op))
+        if (get_irop_info(op).terminator)
             seal_next(info);
     }
-    else if (values.empty() || !end_of_block.count(values.rbegin()->get()->op))
+    else if (values.empty() || !get_irop_info(values.rbegin()->get()->op).terminator)
         values.push_back(std::move(value));
 }
 
-void PartIR::append(const std::vector<std::string> args, std::weak_ptr<IRINFO> info)
+void PartIR::append(IROP op, const std::vector<Symbol> args, std::weak_ptr<IRINFO> info)
 {
-    auto value = std::make_unique<ValueIR>();
-    value->op = args[0];
-    value->args = {};
-    for (int i = 1; i < args.size(); i++)
-        value->args.push_back(args[i]);
+    auto value = info.lock()->new_value(op);
+    value->args.assign(args.begin(), args.end());
     append(std::move(value), info);
 }
 
-void PartIR::seal_prev(const std::string name, const std::string type)
+void PartIR::seal_prev(const Symbol name, const std::string type, std::weak_ptr<IRINFO> info)
 {
-    auto prev_block = std::make_unique<BaseBlockIR>();
+    auto prev_block = make_arena<BaseBlockIR>(info.lock()->get_pool());
     prev_block->name = name;
     prev_block->values.merge(values);
-    if (prev_block->values.empty() || !end_of_block.count(prev_block->values.rbegin()->get()->op))
+    if (prev_block->values.empty() || !get_irop_info(prev_block->values.rbegin()->get()->op).terminator)
     {
-        auto ret = std::make_unique<ValueIR>();
-        ret->op = "ret";
+        auto ret = info.lock()->new_value(IROP::RET);
         if (type == "int")
-            ret->args.push_back("0");
+            ret->args.push_back(intern("0"));
         prev_block->values.push_back(std::move(ret));
     }
     blocks.push_front(std::move(prev_block));
 }
 
-void PartIR::create_new_block(const std::string name)
+void PartIR::create_new_block(const Symbol name)
 {
     assert(!new_values.has_value());
-    new_values = std::make_pair(List<std::unique_ptr<ValueIR>>(), name);
+    new_values = std::make_pair(List<arena_ptr<ValueIR>>(), name);
 }
 
-void PartIR::substitute(const std::string& name1, const std::string& name2)
+void PartIR::append_control(const std::string &type, std::weak_ptr<IRINFO> info)
 {
-    for (auto &value : values)
-        if (value->op == "jump" || value->op == "br")
-            for (auto &arg : value->args)
-                if (arg == name1)
-                    arg = name2;
-    if (new_values.has_value())
-        for (auto &value : new_values.value().first)
-            if (value->op == "jump" || value->op == "br")
-                for (auto &arg : value->args)
-                    if (arg == name1)
-                        arg = name2;
-    for (auto &block : blocks)
-        for (auto &value : block->values)
-            if (value->op == "jump" || value->op == "br")
-                for (auto &arg : value->args)
-                    if (arg == name1)
-                        arg = name2;
+    assert(values.empty() && !new_values.has_value());
+    auto value = info.lock()->new_value(IROP::JUMP);
+    value->args = {intern(type)};
+    (type == "break" ? breaks : continues).push_back(value.get());
+    values.push_back(std::move(value));
+}
+
+void PartIR::patch_controls(const Symbol continue_name, const Symbol break_name)
+{
+    for (auto value : continues)
+        value->args[0] = continue_name;
+    for (auto value : breaks)
+        value->args[0] = break_name;
+    continues.clear();
+    breaks.clear();
 }
 
 void CompUnitAST::to_string(std::string& str, const int tabs) const
@@ -168,7 +179,7 @@ void FuncDefAST::to_string(std::string& str, const int tabs) const
 {
     start_class(str, "FuncDef", tabs);
     new_line(str, "func_type: " + func_type, tabs + 1);
-    new_line(str, "ident: " + ident, tabs + 1);
+    new_line(str, "ident: " + symbol_name(ident), tabs + 1);
     add_tabs(str, tabs + 1);
     str += "block: ";
     block->to_string(str, tabs + 2);
@@ -211,7 +222,7 @@ void ReturnAST::to_string(std::string& str, const int tabs) const
 void AssignAST::to_string(std::string& str, const int tabs) const
 {
     start_class(str, "Assign", tabs);
-    new_line(str, "ident: " + ident, tabs + 1);
+    new_line(str, "ident: " + symbol_name(ident), tabs + 1);
     add_tabs(str, tabs + 1);
     str += "exp: ";
     exp->to_string(str, tabs + 2);
@@ -221,7 +232,7 @@ void AssignAST::to_string(std::string& str, const int tabs) const
 void DefAST::to_string(std::string& str, const int tabs) const
 {
     start_class(str, "Def", tabs);
-    new_line(str, "ident: " + ident, tabs + 1);
+    new_line(str, "ident: " + symbol_name(ident), tabs + 1);
     if (exp.has_value())
     {
         add_tabs(str, tabs + 1);
@@ -235,7 +246,7 @@ void ExpAST::to_string(std::string& str, const int tabs) const
 {
     start_class(str, "Exp", tabs);
     if (value.has_value())
-        new_line(str, "value: " + value.value(), tabs + 1);
+        new_line(str, "value: " + symbol_name(value.value()), tabs + 1);
     else
     {
         new_line(str, "op: " + op, tabs + 1);
@@ -286,8 +297,145 @@ void ControlAST::to_string(std::string &str, const int tabs) const
     end_class(str, "Control", tabs);
 }
 
+namespace
+{
+// the identifiers a function reads and assigns and the functions it calls
+struct EffectScan
+{
+    std::vector<Symbol> reads, writes, calls;
+
+    void exp(const ExpAST &e)
+    {
+        if (e.value.has_value() && !symbol_info(e.value.value()).is_num)
+            reads.push_back(e.value.value());
+        if (e.arr_name.has_value())
+            reads.push_back(e.arr_name.value());
+        if (start_with(e.op, "func_"))
+            calls.push_back(intern(e.op.substr(5)));
+        for (auto const &arg : e.args)
+            exp(*arg);
+    }
+
+    void init(const InitAST &i)
+    {
+        if (i.exp.has_value())
+            exp(*i.exp.value());
+        for (auto const &sub : i.inits)
+            init(*sub);
+    }
+
+    void stmt(const StmtAST &s)
+    {
+        if (auto block = dynamic_cast<const BlockAST *>(&s))
+        {
+            for (auto const &sub : block->stmts)
+                stmt(*sub);
+        }
+        else if (auto exp_stmt = dynamic_cast<const StmtExpAST *>(&s))
+            exp(*exp_stmt->exp);
+        else if (auto ret = dynamic_cast<const ReturnAST *>(&s))
+        {
+            if (ret->exp.has_value())
+                exp(*ret->exp.value());
+        }
+        else if (auto assign = dynamic_cast<const AssignAST *>(&s))
+        {
+            writes.push_back(assign->ident);
+            for (auto const &dim : assign->dims)
+                exp(*dim);
+            exp(*assign->exp);
+        }
+        else if (auto d = dynamic_cast<const DefAST *>(&s))
+        {
+            for (auto const &dim : d->dims)
+                exp(*dim);
+            if (d->exp.has_value())
+                exp(*d->exp.value());
+            if (d->init.has_value())
+                init(*d->init.value());
+        }
+        else if (auto if_stmt = dynamic_cast<const IfAST *>(&s))
+        {
+            exp(*if_stmt->exp);
+            stmt(*if_stmt->then_stmt);
+            if (if_stmt->else_stmt.has_value())
+                stmt(*if_stmt->else_stmt.value());
+        }
+        else if (auto while_stmt = dynamic_cast<const WhileAST *>(&s))
+        {
+            exp(*while_stmt->exp);
+            stmt(*while_stmt->stmt);
+        }
+    }
+};
+}
+
+// What each function touches directly, then what its callees touch, until
+// nothing changes; recursion makes the call graph cyclic. Sets are bit sets
+// over the globals in declaration order.
+std::vector<GlobalEffects> CompUnitAST::global_effects() const
+{
+    std::unordered_map<Symbol, unsigned> global_id, func_id;
+    std::vector<Symbol> globals;
+    for (auto const &def : var_def)
+        global_id[def->ident] = globals.size(), globals.push_back(def->ident);
+    unsigned n = 0;
+    for (auto const &func : func_def)
+        func_id[func->ident] = n++;
+    unsigned words = (globals.size() + 63) / 64;
+    std::vector<uint64_t> reads(n * words, 0), writes(n * words, 0);
+    std::vector<std::vector<unsigned>> callees(n);
+    unsigned f = 0;
+    for (auto const &func : func_def)
+    {
+        EffectScan scan;
+        scan.stmt(*func->block);
+        for (auto name : scan.reads)
+            if (global_id.count(name))
+                reads[f * words + global_id[name] / 64] |= uint64_t(1) << (global_id[name] % 64);
+        for (auto name : scan.writes)
+            if (global_id.count(name))
+                writes[f * words + global_id[name] / 64] |= uint64_t(1) << (global_id[name] % 64);
+        for (auto name : scan.calls)
+            if (func_id.count(name))
+                callees[f].push_back(func_id[name]);
+        f++;
+    }
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (f = 0; f < n; f++)
+            for (auto callee : callees[f])
+                for (unsigned w = 0; w < words; w++)
+                {
+                    uint64_t r = reads[f * words + w] | reads[callee * words + w];
+                    uint64_t wr = writes[f * words + w] | writes[callee * words + w];
+                    if (r != reads[f * words + w] || wr != writes[f * words + w])
+                        reads[f * words + w] = r, writes[f * words + w] = wr, changed = true;
+                }
+    }
+    std::vector<GlobalEffects> result(n);
+    for (f = 0; f < n; f++)
+        for (unsigned g = 0; g < globals.size(); g++)
+        {
+            if (reads[f * words + g / 64] >> (g % 64) & 1)
+                result[f].reads.push_back(globals[g]);
+            if (writes[f * words + g / 64] >> (g % 64) & 1)
+                result[f].writes.push_back(globals[g]);
+        }
+    for (auto &effects : result)
+    {
+        std::sort(effects.reads.begin(), effects.reads.end());
+        std::sort(effects.writes.begin(), effects.writes.end());
+    }
+    return result;
+}
+
 std::unique_ptr<BaseIR> CompUnitAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    std::vector<std::string> keys;
+    if (function_cache)
+        keys = function_cache->keys(*this);
     auto result = std::make_unique<ProgramIR>();
     result->program_info = std::make_unique<IRINFO>();
     result->program_info->current_state = "global def";
@@ -298,21 +446,70 @@ std::unique_ptr<BaseIR> CompUnitAST::to_ir(std::weak_ptr<IRINFO> info) const
         part->merge(temp, info);
     }
     result->program_info->current_state = "";
+    // the backend keeps globals in registers across calls that leave them be
+    auto effects = global_effects();
+    unsigned f = 0;
+    for (auto const &func : func_def)
+    {
+        auto &ir_effects = result->global_riscv_info.effects[func->ident];
+        for (auto name : effects[f].reads)
+            ir_effects.reads.push_back(result->program_info->lookup(name).name);
+        for (auto name : effects[f].writes)
+            ir_effects.writes.push_back(result->program_info->lookup(name).name);
+        std::sort(ir_effects.reads.begin(), ir_effects.reads.end());
+        std::sort(ir_effects.writes.begin(), ir_effects.writes.end());
+        f++;
+    }
+    result->pool = result->program_info->take_pool();
     for (auto &value : part->get_values())
-        result->values.push_back(std::unique_ptr<ValueIR>(value.release()));
+        result->values.push_back(std::move(value));
+    std::vector<const FuncDefAST *> defs;
     for (auto & func_def_ : func_def)
+    {
         result->program_info->set_func(func_def_->ident, func_def_->func_type);
-    for (auto & func_def_ : func_def)
-        result->functions.push_back(std::unique_ptr<FunctionIR>(dynamic_cast<FunctionIR*>(func_def_->to_ir(result->program_info).release())));
+        defs.push_back(func_def_.get());
+    }
+
+    // a body sees only the global scope and the signatures, so every worker
+    // lowers whole functions on its own fork of the global state
+    unsigned workers = parallel_workers(defs.size());
+    std::vector<std::shared_ptr<IRINFO>> forks;
+    std::vector<std::unique_ptr<Arena>> arenas;
+    for (unsigned i = 0; i < workers; i++)
+    {
+        forks.push_back(result->program_info->fork());
+        arenas.push_back(std::make_unique<Arena>());
+    }
+    result->functions.resize(defs.size());
+    parallel_for(defs.size(), [&](size_t i, unsigned worker)
+    {
+        std::string text;
+        if (function_cache && function_cache->load(keys[i], text))
+        {
+            result->functions[i] = std::make_unique<FunctionIR>();
+            result->functions[i]->name = symbol_name(defs[i]->ident);
+            result->functions[i]->return_type = defs[i]->func_type;
+            result->functions[i]->cached = std::move(text);
+            return;
+        }
+        local_ast_arena = arenas[worker].get();
+        result->functions[i].reset(dynamic_cast<FunctionIR*>(defs[i]->to_ir(forks[worker]).release()));
+        local_ast_arena = nullptr;
+        if (function_cache)
+            result->functions[i]->cache_key = std::move(keys[i]);
+    });
+    for (auto &arena : arenas)
+        ast_arena.adopt(std::move(arena));
     return result;
 }
 
 std::unique_ptr<BaseIR> FuncDefAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    PhaseTimer timer("ir", &symbol_name(ident));
     info.lock()->inc_level();
-    info.lock()->func_name = ident;
+    info.lock()->func_name = symbol_name(ident);
     auto result = std::make_unique<FunctionIR>();
-    List<std::pair<std::string, List<std::optional<unsigned>>>> num_args;
+    List<std::pair<Symbol, List<std::optional<unsigned>>>> num_args;
     for (auto &arg : args)
     {
         List<std::optional<unsigned>> num_dims;
@@ -321,8 +518,8 @@ std::unique_ptr<BaseIR> FuncDefAST::to_ir(std::weak_ptr<IRINFO> info) const
             if (dim.has_value())
             {
                 dim.value()->try_eval(info);
-                assert(dim.value()->value.has_value() && is_num(dim.value()->value.value()));
-                num_dims.push_back(std::stoi(dim.value()->value.value()));
+                assert(dim.value()->value.has_value() && symbol_info(dim.value()->value.value()).is_num);
+                num_dims.push_back(symbol_info(dim.value()->value.value()).num);
             }
             else
                 num_dims.push_back(std::nullopt);
@@ -331,19 +528,25 @@ std::unique_ptr<BaseIR> FuncDefAST::to_ir(std::weak_ptr<IRINFO> info) const
     }
     auto prealloc_ir = info.lock()->start_func(num_args, result->args, info);
     auto part_ir = std::unique_ptr<PartIR>(dynamic_cast<PartIR*>(block->to_ir(info).release()));
+    // allocations and the implicit return belong to no statement
+    info.lock()->line = 0;
     result->return_type = func_type;
     auto alloc_ir = info.lock()->get_alloc(info);
     alloc_ir->merge(prealloc_ir, info);
     alloc_ir->merge(part_ir, info);
-    result->name = ident;
-    alloc_ir->seal_prev("\%entry", func_type);
+    result->name = symbol_name(ident);
+    alloc_ir->seal_prev(intern("\%entry"), func_type, info);
     alloc_ir->seal_next(info);
-    alloc_ir->create_new_block("\%labelexit_" + ident);
+    alloc_ir->create_new_block(intern("\%labelexit_" + result->name));
     if (func_type == "int")
-        alloc_ir->append({"ret", "0"}, info);
+        alloc_ir->append(IROP::RET, {intern("0")}, info);
     else
-        alloc_ir->append({"ret"}, info);
+        alloc_ir->append(IROP::RET, {}, info);
     result->base_blocks.merge(alloc_ir->blocks);
+    result->cfg.build(result->base_blocks, info.lock()->loops);
+    result->pool = info.lock()->take_pool();
+    if (mem2reg_enabled)
+        result->mem2reg();
     info.lock()->end_func();
     info.lock()->dec_level();
     return std::unique_ptr<BaseIR>(dynamic_cast<BaseIR*>(result.release()));
@@ -364,6 +567,7 @@ std::unique_ptr<BaseIR> BlockAST::to_ir(std::weak_ptr<IRINFO> info) const
 
 std::unique_ptr<BaseIR> StmtExpAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    info.lock()->line = line;
     exp->try_eval(info);
     auto result_part = std::make_unique<PartIR>();
     if (!exp->value.has_value())
@@ -376,12 +580,13 @@ std::unique_ptr<BaseIR> StmtExpAST::to_ir(std::weak_ptr<IRINFO> info) const
 
 std::unique_ptr<BaseIR> ReturnAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    info.lock()->line = line;
     if (exp.has_value())
         exp.value()->try_eval(info);
     auto result_part = std::make_unique<PartIR>();
     if (exp.has_value())
     {
-        std::string arg;
+        Symbol arg;
         if (exp.value()->value.has_value())
             arg = value_exp_to_ir(exp.value(), result_part, info);
         else
@@ -390,10 +595,10 @@ std::unique_ptr<BaseIR> ReturnAST::to_ir(std::weak_ptr<IRINFO> info) const
             result_part->merge(exp_ir, info);
             arg = info.lock()->last_result;
         }
-        result_part->append({"ret", arg}, info);
+        result_part->append(IROP::RET, {arg}, info);
     }
     else
-        result_part->append({"ret"}, info);
+        result_part->append(IROP::RET, {}, info);
     return result_part;
 }
 
@@ -403,10 +608,11 @@ std::unique_ptr<BaseIR> ExpAST::to_ir(std::weak_ptr<IRINFO> info) const
     auto shared_info = info.lock();
     assert(!value.has_value());
 
-    List<std::string> arg_names;
+    List<Symbol> arg_names;
     List<std::optional<std::unique_ptr<PartIR>>> arg_irs;
-    auto value_ir = std::make_unique<ValueIR>();
-    std::string current = shared_info->allocate_var(op);
+    auto value_ir = shared_info->new_value(IROP::NOTE);
+    Symbol current = shared_info->allocate_var(op);
+    Symbol zero = intern("0"), one = intern("1");
 
     for (auto & arg : args)
     {
@@ -427,33 +633,33 @@ std::unique_ptr<BaseIR> ExpAST::to_ir(std::weak_ptr<IRINFO> info) const
         if (arg_irs.begin()->has_value())
             result->merge(arg_irs.begin()->value(), info);
 
-        std::string comp_name = shared_info->allocate_label(op+"_comp"), lazy_name = shared_info->allocate_label(op+"_lazy"), next_name = shared_info->allocate_label(op+"_next");
-        std::string alloc_name = shared_info->allocate_var(op+"_alloc", false);
+        Symbol comp_name = shared_info->allocate_label(op+"_comp"), lazy_name = shared_info->allocate_label(op+"_lazy"), next_name = shared_info->allocate_label(op+"_next");
+        Symbol alloc_name = shared_info->allocate_var(op+"_alloc", false);
 
         if (op == "and")
-            result->append({"br", *arg_names.begin(), comp_name, lazy_name}, info);
+            result->append(IROP::BR, {*arg_names.begin(), comp_name, lazy_name}, info);
         else
-            result->append({"br", *arg_names.begin(), lazy_name, comp_name}, info);
+            result->append(IROP::BR, {*arg_names.begin(), lazy_name, comp_name}, info);
 
         result->create_new_block(lazy_name);
-        result->append({"store", std::to_string(int(op == "or")), alloc_name}, info);
-        result->append({"jump", next_name}, info);
+        result->append(IROP::STORE, {op == "or" ? one : zero, alloc_name}, info);
+        result->append(IROP::JUMP, {next_name}, info);
 
         result->create_new_block(comp_name);
         if (arg_irs.rbegin()->has_value())
             result->merge(arg_irs.rbegin()->value(), info);
-        if (is_num(*arg_names.rbegin()))
-            result->append({"store", (*arg_names.rbegin() == "0") ? "0" : "1", alloc_name}, info);
+        if (symbol_info(*arg_names.rbegin()).is_num)
+            result->append(IROP::STORE, {(*arg_names.rbegin() == zero) ? zero : one, alloc_name}, info);
         else
         {
             auto boolize_name = shared_info->allocate_var(op+"_boolize");
-            result->append({"ne", boolize_name, *arg_names.rbegin(), "0"}, info);
-            result->append({"store", boolize_name, alloc_name}, info);
+            result->append(IROP::NE, {boolize_name, *arg_names.rbegin(), zero}, info);
+            result->append(IROP::STORE, {boolize_name, alloc_name}, info);
         }
 
-        result->append({"jump", next_name}, info);
+        result->append(IROP::JUMP, {next_name}, info);
         result->create_new_block(next_name);
-        result->append({"load", current, alloc_name}, info);
+        result->append(IROP::LOAD, {current, alloc_name}, info);
     }
     else if (op == "and" || op == "or")
     {
@@ -461,41 +667,41 @@ std::unique_ptr<BaseIR> ExpAST::to_ir(std::weak_ptr<IRINFO> info) const
             if (arg_ir.has_value())
                 result->merge(arg_ir.value(), info);
         auto boolize_name_1 = shared_info->allocate_var(op+"_boolize");
-        if (is_num(*arg_names.begin()))
-            boolize_name_1 = (*arg_names.begin() == "0") ? "0" : "1";
+        if (symbol_info(*arg_names.begin()).is_num)
+            boolize_name_1 = (*arg_names.begin() == zero) ? zero : one;
         else
-            result->append({"ne", boolize_name_1, *arg_names.begin(), "0"}, info);
+            result->append(IROP::NE, {boolize_name_1, *arg_names.begin(), zero}, info);
         auto boolize_name_2 = shared_info->allocate_var(op+"_boolize");
-        if (is_num(*arg_names.rbegin()))
-            boolize_name_2 = (*arg_names.rbegin() == "0") ? "0" : "1";
+        if (symbol_info(*arg_names.rbegin()).is_num)
+            boolize_name_2 = (*arg_names.rbegin() == zero) ? zero : one;
         else
-            result->append({"ne", boolize_name_2, *arg_names.rbegin(), "0"}, info);
-        result->append({op, current, boolize_name_1, boolize_name_2}, info);
+            result->append(IROP::NE, {boolize_name_2, *arg_names.rbegin(), zero}, info);
+        result->append(irop_from_name(op), {current, boolize_name_1, boolize_name_2}, info);
     }
     else if (start_with(op, "func"))
     {
         for (auto & arg_ir : arg_irs)
             if (arg_ir.has_value())
                 result->merge(arg_ir.value(), info);
-        auto func_name = op.substr(5);
-        value_ir->args = {op.substr(5)};
+        auto func_name = intern(op.substr(5));
+        value_ir->args = {func_name};
         if (info.lock()->get_func(func_name) == "int")
-            value_ir->op = "call_int", value_ir->args.push_back(current);
+            value_ir->op = IROP::CALL_INT, value_ir->args.push_back(current);
         else if (info.lock()->get_func(func_name) == "void")
-            value_ir->op = "call_void";
+            value_ir->op = IROP::CALL_VOID;
         for (auto & arg_name : arg_names)
             value_ir->args.push_back(arg_name);
-        result->append(std::unique_ptr<ValueIR>(value_ir.release()), info);
+        result->append(std::move(value_ir), info);
     }
     else if (start_with(op, "at"))
     {
         if (arg_irs.begin()->has_value())
             result->merge(arg_irs.begin()->value(), info);
-        std::string parr_name = info.lock()->get_var_name(arr_name.value());
-        std::string getptrname = info.lock()->allocate_var("atptr");
-        result->append({shared_info->is_arg(parr_name) ? "getptr" : "getelemptr", getptrname, parr_name, *arg_names.begin()}, info);
+        Symbol parr_name = info.lock()->get_var_name(arr_name.value());
+        Symbol getptrname = info.lock()->allocate_var("atptr");
+        result->append(shared_info->is_arg(arr_name.value()) ? IROP::GETPTR : IROP::GETELEMPTR, {getptrname, parr_name, *arg_names.begin()}, info);
         if (op == "at")
-            result->append({"load", current, getptrname}, info);
+            result->append(IROP::LOAD, {current, getptrname}, info);
         else
             current = getptrname;
     }
@@ -504,9 +710,9 @@ std::unique_ptr<BaseIR> ExpAST::to_ir(std::weak_ptr<IRINFO> info) const
         for (auto & arg_ir : arg_irs)
             if (arg_ir.has_value())
                 result->merge(arg_ir.value(), info);
-        value_ir->op = op;
+        value_ir->op = irop_from_name(op);
         value_ir->args = {current, *arg_names.begin(), *arg_names.rbegin()};
-        result->append(std::unique_ptr<ValueIR>(value_ir.release()), info);
+        result->append(std::move(value_ir), info);
     }
 
     shared_info->last_result = current;
@@ -515,11 +721,11 @@ std::unique_ptr<BaseIR> ExpAST::to_ir(std::weak_ptr<IRINFO> info) const
 
 std::unique_ptr<BaseIR> AssignAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    info.lock()->line = line;
     exp->try_eval(info);
     auto result_part = std::make_unique<PartIR>();
-    auto result = std::make_unique<ValueIR>();
-    std::string name = info.lock()->get_var_name(ident);
-    result->op = "store";
+    auto result = info.lock()->new_value(IROP::STORE);
+    Symbol name = info.lock()->get_var_name(ident);
     if (exp->value.has_value())
         result->args.push_back(value_exp_to_ir(exp, result_part, info));
     else
@@ -532,7 +738,7 @@ std::unique_ptr<BaseIR> AssignAST::to_ir(std::weak_ptr<IRINFO> info) const
         result->args.push_back(name);
     else
     {
-        auto at_exp = std::make_unique<ExpAST>();
+        auto at_exp = make_arena<ExpAST>(current_ast_arena());
         at_exp->op = "at_woload";
         at_exp->arr_name = ident;
         for (const auto &dim : dims)
@@ -553,6 +759,7 @@ std::unique_ptr<BaseIR> InitAST::to_ir(std::weak_ptr<IRINFO> info) const
 
 std::unique_ptr<BaseIR> DefAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    info.lock()->line = line;
     if (exp.has_value())
         exp.value()->try_eval(info);
     auto result_part = std::make_unique<PartIR>();
@@ -560,20 +767,19 @@ std::unique_ptr<BaseIR> DefAST::to_ir(std::weak_ptr<IRINFO> info) const
     for (auto &exp : dims)
     {
         exp->try_eval(info);
-        assert(exp->value.has_value() && is_num(exp->value.value()));
-        num_dims.push_back(std::stoi(exp->value.value()));
+        assert(exp->value.has_value() && symbol_info(exp->value.value()).is_num);
+        num_dims.push_back(symbol_info(exp->value.value()).num);
     }
-    std::string name = info.lock()->allocate_var(ident, false, true, false, num_dims);
-    if (is_const && exp.has_value() && exp.value()->value.has_value() && is_num(exp.value()->value.value()))
+    Symbol name = info.lock()->define_var(ident, false, num_dims);
+    if (is_const && exp.has_value() && exp.value()->value.has_value() && symbol_info(exp.value()->value.value()).is_num)
     {
         info.lock()->set_const(ident, exp.value()->value.value());
         return result_part;
     }
     else if (exp.has_value())
     {
-        auto result2 = std::make_unique<ValueIR>();
-        result2->op = (info.lock()->current_state == "global def") ? "global alloc" : "store";
-        std::string value;
+        auto result2 = info.lock()->new_value((info.lock()->current_state == "global def") ? IROP::GLOBAL_ALLOC : IROP::STORE);
+        Symbol value;
         if (exp.value()->value.has_value())
             value = value_exp_to_ir(exp.value(), result_part, info);
         else
@@ -583,7 +789,7 @@ std::unique_ptr<BaseIR> DefAST::to_ir(std::weak_ptr<IRINFO> info) const
             value = info.lock()->last_result;
         }
         if (info.lock()->current_state == "global def")
-            result2->args = {name, "i32", value};
+            result2->args = {name, intern("i32"), value};
         else
             result2->args = {value, name};
         result_part->append(std::move(result2), info);
@@ -591,7 +797,7 @@ std::unique_ptr<BaseIR> DefAST::to_ir(std::weak_ptr<IRINFO> info) const
     else if (num_dims.empty())
     {
         if (info.lock()->current_state == "global def")
-            result_part->append({"global alloc", name, "i32", "undef"}, info);
+            result_part->append(IROP::GLOBAL_ALLOC, {name, intern("i32"), intern("undef")}, info);
     }
     else
     {
@@ -601,17 +807,23 @@ std::unique_ptr<BaseIR> DefAST::to_ir(std::weak_ptr<IRINFO> info) const
         if (init.has_value())
             init.value()->try_eval(info, num_dims);
         if (info.lock()->current_state == "global def")
-            result_part->append({"global alloc", name, "[i32, " + std::to_string(size) + "]", init.has_value() ? init.value()->to_ir_string(info) : "undef"}, info);
+        {
+            auto value = info.lock()->new_value(IROP::GLOBAL_ALLOC);
+            value->args = {name, intern("[i32, " + std::to_string(size) + "]"), intern("undef")};
+            if (init.has_value())
+                value->args[2] = init_sym, value->init = init.value()->to_ir_init(info);
+            result_part->append(std::move(value), info);
+        }
         else
         {
             if (init.has_value())
             {
-                int cur = -1;
                 auto store_part = std::make_unique<PartIR>();
-                for (auto &e : init.value()->exps)
+                for (auto &it : init.value()->exps)
                 {
-                    std::string result;
-                    cur++;
+                    Symbol result;
+                    auto &e = it.second;
+                    unsigned cur = it.first;
                     if (e->value.has_value())
                     {
                         if (try_cal_str_value(e->value.value(), info).has_value())
@@ -625,11 +837,14 @@ std::unique_ptr<BaseIR> DefAST::to_ir(std::weak_ptr<IRINFO> info) const
                         result_part->merge(p, info);
                         result = info.lock()->last_result;
                     }
-                    std::string temp = info.lock()->allocate_var("getelemptr");
-                    store_part->append({"getelemptr", temp, name, std::to_string(cur)}, info);
-                    store_part->append({"store", result, temp}, info);
+                    Symbol temp = info.lock()->allocate_var("getelemptr");
+                    store_part->append(IROP::GETELEMPTR, {temp, name, intern(std::to_string(cur))}, info);
+                    store_part->append(IROP::STORE, {result, temp}, info);
                 }
-                result_part->append({"store", init.value()->to_ir_string(info), name}, info);
+                auto value = info.lock()->new_value(IROP::STORE);
+                value->args = {init_sym, name};
+                value->init = init.value()->to_ir_init(info);
+                result_part->append(std::move(value), info);
                 result_part->merge(store_part, info);
             }
         }
@@ -639,9 +854,10 @@ std::unique_ptr<BaseIR> DefAST::to_ir(std::weak_ptr<IRINFO> info) const
 
 std::unique_ptr<BaseIR> IfAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    info.lock()->line = line;
     exp->try_eval(info);
     auto result_part = std::make_unique<PartIR>();
-    std::string arg;
+    Symbol arg;
     if (exp->value.has_value())
         arg = value_exp_to_ir(exp, result_part, info);
     else
@@ -650,20 +866,20 @@ std::unique_ptr<BaseIR> IfAST::to_ir(std::weak_ptr<IRINFO> info) const
         result_part->merge(exp_ir, info);
         arg = info.lock()->last_result;
     }
-    std::string then_name = info.lock()->allocate_label("if_then"), else_name = info.lock()->allocate_label("if_else"), next_name = info.lock()->allocate_label("if_next");
-    result_part->append({"br", arg, then_name, else_stmt.has_value() ? else_name : next_name}, info);
+    Symbol then_name = info.lock()->allocate_label("if_then"), else_name = info.lock()->allocate_label("if_else"), next_name = info.lock()->allocate_label("if_next");
+    result_part->append(IROP::BR, {arg, then_name, else_stmt.has_value() ? else_name : next_name}, info);
 
     result_part->create_new_block(then_name);
     auto then_ir = std::unique_ptr<PartIR>(dynamic_cast<PartIR *>(then_stmt->to_ir(info).release()));
     result_part->merge(then_ir, info);
-    result_part->append({"jump", next_name}, info);
+    result_part->append(IROP::JUMP, {next_name}, info);
 
     if (else_stmt.has_value())
     {
         result_part->create_new_block(else_name);
         auto else_ir = std::unique_ptr<PartIR>(dynamic_cast<PartIR *>(else_stmt.value()->to_ir(info).release()));
         result_part->merge(else_ir, info);
-        result_part->append({"jump", next_name}, info);
+        result_part->append(IROP::JUMP, {next_name}, info);
     }
 
     result_part->create_new_block(next_name);
@@ -672,13 +888,14 @@ std::unique_ptr<BaseIR> IfAST::to_ir(std::weak_ptr<IRINFO> info) const
 
 std::unique_ptr<BaseIR> WhileAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    info.lock()->line = line;
     exp->try_eval(info);
-    std::string cond_name = info.lock()->allocate_label("while_cond"), then_name = info.lock()->allocate_label("while_then"), next_name = info.lock()->allocate_label("while_next");
+    Symbol cond_name = info.lock()->allocate_label("while_cond"), then_name = info.lock()->allocate_label("while_then"), next_name = info.lock()->allocate_label("while_next");
     auto result_part = std::make_unique<PartIR>();
-    result_part->append({"jump", cond_name}, info);
+    result_part->append(IROP::JUMP, {cond_name}, info);
     result_part->create_new_block(cond_name);
 
-    std::string arg;
+    Symbol arg;
     if (exp->value.has_value())
         arg = value_exp_to_ir(exp, result_part, info);
     else
@@ -687,29 +904,31 @@ std::unique_ptr<BaseIR> WhileAST::to_ir(std::weak_ptr<IRINFO> info) const
         result_part->merge(exp_ir, info);
         arg = info.lock()->last_result;
     }
-    result_part->append({"br", arg, then_name, next_name}, info);
+    result_part->append(IROP::BR, {arg, then_name, next_name}, info);
 
     result_part->create_new_block(then_name);
     auto then_ir = std::unique_ptr<PartIR>(dynamic_cast<PartIR *>(stmt->to_ir(info).release()));
     result_part->merge(then_ir, info);
-    result_part->append({"jump", cond_name}, info);
+    info.lock()->line = line;
+    result_part->append(IROP::JUMP, {cond_name}, info);
 
     result_part->create_new_block(next_name);
 
-    result_part->substitute("continue", cond_name);
-    result_part->substitute("break", next_name);
+    result_part->patch_controls(cond_name, next_name);
+    info.lock()->loops.push_back({cond_name, next_name});
 
     return result_part;
 }
 
 std::unique_ptr<BaseIR> ControlAST::to_ir(std::weak_ptr<IRINFO> info) const
 {
+    info.lock()->line = line;
     auto part = std::make_unique<PartIR>();
-    part->append({"jump", type}, info);
+    part->append_control(type, info);
     return part;
 }
 
-void StmtsAST::merge(std::unique_ptr<StmtsAST>& stmts2)
+void StmtsAST::merge(arena_ptr<StmtsAST>& stmts2)
 {
     stmts.merge(stmts2->stmts);
 }
@@ -731,26 +950,26 @@ void ExpAST::try_eval(std::weak_ptr<IRINFO> info)
         auto dims = info.lock()->get_type(arr_name.value());
         if (dims.size() != args.size())
             op = "at_woload";
-        std::vector<std::unique_ptr<ExpAST>> muls;
+        std::vector<arena_ptr<ExpAST>> muls;
         int i = 0;
         for (auto & arg : args)
         {
-            auto mul = std::make_unique<ExpAST>();
-            auto s = std::make_unique<ExpAST>();
+            auto mul = make_arena<ExpAST>(current_ast_arena());
+            auto s = make_arena<ExpAST>(current_ast_arena());
             mul->op = "mul";
             int size = 1;
             for (int j = i + 1; j < dims.size(); j++)
                 size *= dims[j].value();
-            s->value = std::to_string(size);
+            s->value = intern(std::to_string(size));
             mul->args.push_back(std::move(arg));
             mul->args.push_back(std::move(s));
             muls.push_back(std::move(mul));
             i++;
         }
-        std::unique_ptr<ExpAST> new_value = std::move(muls[0]);
+        arena_ptr<ExpAST> new_value = std::move(muls[0]);
         for (int i = 1; i < muls.size(); i++)
         {
-            auto add = std::make_unique<ExpAST>();
+            auto add = make_arena<ExpAST>(current_ast_arena());
             add->op = "add";
             add->args.push_back(std::move(new_value));
             add->args.push_back(std::move(muls[i]));
@@ -780,39 +999,39 @@ void ExpAST::try_eval(std::weak_ptr<IRINFO> info)
     {
         int lhs_val, rhs_val;
         if (try_cal_value_exp(lhs, info).has_value())
-            lhs_val = std::stoi(try_cal_value_exp(lhs, info).value());
+            lhs_val = symbol_info(try_cal_value_exp(lhs, info).value()).num;
         else
             return;
         if (try_cal_value_exp(rhs, info).has_value())
-            rhs_val = std::stoi(try_cal_value_exp(rhs, info).value());
+            rhs_val = symbol_info(try_cal_value_exp(rhs, info).value()).num;
         else
             return;
         if (op == "add")
-            value = std::to_string(lhs_val + rhs_val);
+            value = intern(std::to_string(lhs_val + rhs_val));
         else if (op == "sub")
-            value = std::to_string(lhs_val - rhs_val);
+            value = intern(std::to_string(lhs_val - rhs_val));
         else if (op == "mul")
-            value = std::to_string(lhs_val * rhs_val);
+            value = intern(std::to_string(lhs_val * rhs_val));
         else if (op == "div")
-            value = std::to_string(lhs_val / rhs_val);
+            value = intern(std::to_string(lhs_val / rhs_val));
         else if (op == "mod")
-            value = std::to_string(lhs_val % rhs_val);
+            value = intern(std::to_string(lhs_val % rhs_val));
         else if (op == "and")
-            value = std::to_string(lhs_val && rhs_val);
+            value = intern(std::to_string(lhs_val && rhs_val));
         else if (op == "or")
-            value = std::to_string(lhs_val || rhs_val);
+            value = intern(std::to_string(lhs_val || rhs_val));
         else if (op == "eq")
-            value = std::to_string(lhs_val == rhs_val);
+            value = intern(std::to_string(lhs_val == rhs_val));
         else if (op == "ne")
-            value = std::to_string(lhs_val != rhs_val);
+            value = intern(std::to_string(lhs_val != rhs_val));
         else if (op == "lt")
-            value = std::to_string(lhs_val < rhs_val);
+            value = intern(std::to_string(lhs_val < rhs_val));
         else if (op == "gt")
-            value = std::to_string(lhs_val > rhs_val);
+            value = intern(std::to_string(lhs_val > rhs_val));
         else if (op == "le")
-            value = std::to_string(lhs_val <= rhs_val);
+            value = intern(std::to_string(lhs_val <= rhs_val));
         else if (op == "ge")
-            value = std::to_string(lhs_val >= rhs_val);
+            value = intern(std::to_string(lhs_val >= rhs_val));
     }
 }
 
@@ -821,7 +1040,8 @@ void InitAST::try_eval(std::weak_ptr<IRINFO> info, const List<std::optional<unsi
     if (exp.has_value())
     {
         exp.value()->try_eval(info);
-        exps.push_back(std::move(exp.value()));
+        exps.push_back({0, std::move(exp.value())});
+        size = 1;
     }
     else
     {
@@ -849,35 +1069,36 @@ void InitAST::try_eval(std::weak_ptr<IRINFO> info, const List<std::optional<unsi
                 }
                 init->try_eval(info, new_dims);
             }
-            current_num += init->exps.size();
+            for (auto &it : init->exps)
+                it.first += current_num;
+            current_num += init->size;
             exps.merge(init->exps);
         }
-        for (int i = 0; i < total_num - current_num; i++)
-        {
-            auto zero = std::make_unique<ExpAST>();
-            zero->value = "0";
-            exps.push_back(std::move(zero));
-        }
+        size = std::max(current_num, total_num);
     }
 }
 
-std::string InitAST::to_ir_string(std::weak_ptr<IRINFO> info)
+arena_ptr<InitIR> InitAST::to_ir_init(std::weak_ptr<IRINFO> info) const
 {
-    std::string result = "{";
-    for (auto &exp_ : exps)
+    Symbol zero = intern("0");
+    auto result = make_arena<InitIR>(info.lock()->get_pool(), info.lock()->get_pool(), size);
+    for (auto &it : exps)
     {
+        auto &exp_ = it.second;
         if (exp_->value.has_value() && try_cal_str_value(exp_->value.value(), info))
-            result += exp_->value.value() + ", ";
+        {
+            if (exp_->value.value() != zero)
+                result->values.push_back({it.first, exp_->value.value()});
+        }
         else
-            result += "undef, ";
+            result->values.push_back({it.first, std::nullopt});
     }
-    result = result.substr(0, result.size() - 2) + "}";
     return result;
 }
 
-std::unique_ptr<ExpAST> ExpAST::copy() const
+arena_ptr<ExpAST> ExpAST::copy() const
 {
-    auto result = std::make_unique<ExpAST>();
+    auto result = make_arena<ExpAST>(current_ast_arena());
     result->op = op;
     result->value = value;
     result->arr_name = arr_name;
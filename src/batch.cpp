@@ -0,0 +1,233 @@
+#include <batch.h>
+#include <log.h>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unordered_map>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define REQUEST_TIMEOUT 5
+
+static std::vector<std::string> split_args(const std::string &line)
+{
+    std::istringstream in(line);
+    std::vector<std::string> args;
+    std::string arg;
+    while (in >> arg)
+        args.push_back(arg);
+    return args;
+}
+
+static std::string describe(int status)
+{
+    if (WIFSIGNALED(status))
+        return "signal " + std::to_string(WTERMSIG(status));
+    return "exit " + std::to_string(WEXITSTATUS(status));
+}
+
+static bool succeeded(int status)
+{
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// the child's side of fork(): run the job and leave without unwinding the parent's state
+[[noreturn]] static void run_child(JobRunner run, const std::vector<std::string> &args)
+{
+    int code = run(args);
+    std::cout.flush();
+    _exit(code & 0xff);
+}
+
+int run_batch(const char *manifest, unsigned workers, JobRunner run)
+{
+    std::ifstream in(manifest);
+    if (!in)
+    {
+        logger(LogLevel::ERROR) << "cannot open " << manifest << std::endl;
+        return 1;
+    }
+    std::vector<std::vector<std::string>> jobs;
+    std::vector<unsigned> lines;
+    std::string line;
+    for (unsigned number = 1; std::getline(in, line); number++)
+    {
+        auto args = split_args(line.substr(0, line.find('#')));
+        if (args.empty())
+            continue;
+        jobs.push_back(std::move(args));
+        lines.push_back(number);
+    }
+
+    std::unordered_map<pid_t, size_t> running;
+    size_t next = 0, failed = 0;
+    while (next < jobs.size() || !running.empty())
+    {
+        if (next < jobs.size() && running.size() < workers)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+                run_child(run, jobs[next]);
+            if (pid < 0)
+            {
+                logger(LogLevel::ERROR) << manifest << ":" << lines[next] << ": cannot fork: " << strerror(errno) << std::endl;
+                failed++, next++;
+            }
+            else
+                running[pid] = next++;
+            continue;
+        }
+        int status;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0)
+            break;
+        auto it = running.find(pid);
+        if (it == running.end())
+            continue;
+        if (!succeeded(status))
+        {
+            logger(LogLevel::ERROR) << manifest << ":" << lines[it->second] << ": " << describe(status) << std::endl;
+            failed++;
+        }
+        running.erase(it);
+    }
+    logger(LogLevel::INFO) << "batch: " << jobs.size() << " jobs, " << failed << " failed" << std::endl;
+    return failed ? 1 : 0;
+}
+
+static bool read_request(int conn, std::string &line)
+{
+    char c;
+    while (true)
+    {
+        ssize_t n = read(conn, &c, 1);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return !line.empty();
+        if (c == '\n')
+            return true;
+        line += c;
+    }
+}
+
+// runs in a child of the server, so the job's exit status can still be
+// reported when the job itself dies; relative paths resolve against cwd
+[[noreturn]] static void serve_job(int conn, JobRunner run, const std::string &cwd, const std::vector<std::string> &args)
+{
+    if (!cwd.empty() && chdir(cwd.c_str()) < 0)
+    {
+        std::string reply = "cannot enter " + cwd + ": " + strerror(errno) + "\nexit 1\n";
+        ssize_t ignored = write(conn, reply.data(), reply.size());
+        (void)ignored;
+        close(conn);
+        _exit(0);
+    }
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        dup2(conn, STDOUT_FILENO);
+        dup2(conn, STDERR_FILENO);
+        close(conn);
+        run_child(run, args);
+    }
+    std::string reply;
+    int status;
+    if (pid < 0)
+        reply = std::string("cannot fork: ") + strerror(errno) + "\nexit 1\n";
+    else
+    {
+        while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+            ;
+        reply = describe(status) + "\n";
+    }
+    ssize_t ignored = write(conn, reply.data(), reply.size());
+    (void)ignored;
+    close(conn);
+    _exit(0);
+}
+
+int run_server(const char *socket_path, unsigned workers, JobRunner run)
+{
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        logger(LogLevel::ERROR) << "socket path too long: " << socket_path << std::endl;
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(socket_path);
+    if (fd < 0 || bind(fd, (sockaddr *)&addr, sizeof(addr)) < 0 || listen(fd, 64) < 0)
+    {
+        logger(LogLevel::ERROR) << "cannot listen on " << socket_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    // a client that goes away early must not kill the job reporting to it
+    signal(SIGPIPE, SIG_IGN);
+    logger(LogLevel::INFO) << "serving on " << socket_path << std::endl;
+
+    unsigned running = 0;
+    while (true)
+    {
+        while (running && waitpid(-1, nullptr, running >= workers ? 0 : WNOHANG) > 0)
+            running--;
+        int conn = accept(fd, nullptr, nullptr);
+        if (conn < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            logger(LogLevel::ERROR) << "accept: " << strerror(errno) << std::endl;
+            break;
+        }
+        // a client that never finishes its request line cannot stall the server
+        timeval timeout = {REQUEST_TIMEOUT, 0};
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        std::string line;
+        if (!read_request(conn, line))
+        {
+            close(conn);
+            continue;
+        }
+        auto args = split_args(line);
+        if (args.size() == 1 && args[0] == "shutdown")
+        {
+            close(conn);
+            break;
+        }
+        std::string cwd;
+        if (!args.empty() && args[0].rfind("--cwd=", 0) == 0)
+        {
+            cwd = args[0].substr(strlen("--cwd="));
+            args.erase(args.begin());
+        }
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            close(fd);
+            serve_job(conn, run, cwd, args);
+        }
+        if (pid < 0)
+        {
+            std::string reply = std::string("cannot fork: ") + strerror(errno) + "\nexit 1\n";
+            ssize_t ignored = write(conn, reply.data(), reply.size());
+            (void)ignored;
+        }
+        else
+            running++;
+        close(conn);
+    }
+    close(fd);
+    unlink(socket_path);
+    while (running && waitpid(-1, nullptr, 0) > 0)
+        running--;
+    return 0;
+}
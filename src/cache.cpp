@@ -0,0 +1,373 @@
+#include <cache.h>
+#include <ast.h>
+#include <log.h>
+#include <str.h>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+FunctionCache *function_cache = nullptr;
+
+// 128 bits as hex, from two differently mixed 64-bit lanes
+static std::string digest(const std::string &data)
+{
+    uint64_t a = 0xcbf29ce484222325ull, b = 0x9e3779b97f4a7c15ull ^ data.size();
+    for (unsigned char c : data)
+    {
+        a = (a ^ c) * 0x100000001b3ull;
+        b = (b ^ c) * 0xff51afd7ed558ccdull;
+        b ^= b >> 32;
+    }
+    char buf[33];
+    snprintf(buf, sizeof(buf), "%016llx%016llx", (unsigned long long)a, (unsigned long long)b);
+    return buf;
+}
+
+namespace
+{
+// spells out a subtree as it came from the parser, noting the names it uses
+class Serializer
+{
+public:
+    std::string out;
+    std::vector<Symbol> names;
+    std::vector<std::string> calls;
+    bool lines = false;
+
+    void word(const std::string &w)
+    {
+        out += w;
+        out += ' ';
+    }
+
+    void name(Symbol sym)
+    {
+        word(symbol_name(sym));
+        names.push_back(sym);
+    }
+
+    void exp(const ExpAST &e)
+    {
+        word("(" + e.op);
+        if (e.value.has_value())
+        {
+            if (symbol_info(e.value.value()).is_num)
+                word(symbol_name(e.value.value()));
+            else
+                name(e.value.value());
+        }
+        if (e.arr_name.has_value())
+            name(e.arr_name.value());
+        if (start_with(e.op, "func_"))
+            calls.push_back(e.op.substr(5));
+        for (auto const &arg : e.args)
+            exp(*arg);
+        word(")");
+    }
+
+    void exp(const std::optional<arena_ptr<ExpAST>> &e)
+    {
+        if (e.has_value())
+            exp(*e.value());
+        else
+            word("_");
+    }
+
+    void init(const InitAST &i)
+    {
+        word("{");
+        exp(i.exp);
+        for (auto const &sub : i.inits)
+            init(*sub);
+        word("}");
+    }
+
+    void def(const DefAST &d)
+    {
+        word(d.is_const ? "const" : "int");
+        name(d.ident);
+        word("[");
+        for (auto const &dim : d.dims)
+            exp(*dim);
+        word("]");
+        exp(d.exp);
+        if (d.init.has_value())
+            init(*d.init.value());
+    }
+
+    void stmt(const StmtAST &s)
+    {
+        if (lines)
+            word("@" + std::to_string(s.line));
+        if (auto block = dynamic_cast<const BlockAST *>(&s))
+        {
+            word("{");
+            for (auto const &sub : block->stmts)
+                stmt(*sub);
+            word("}");
+        }
+        else if (auto exp_stmt = dynamic_cast<const StmtExpAST *>(&s))
+        {
+            word("exp");
+            exp(*exp_stmt->exp);
+        }
+        else if (auto ret = dynamic_cast<const ReturnAST *>(&s))
+        {
+            word("return");
+            exp(ret->exp);
+        }
+        else if (auto assign = dynamic_cast<const AssignAST *>(&s))
+        {
+            word("assign");
+            name(assign->ident);
+            for (auto const &dim : assign->dims)
+                exp(*dim);
+            exp(*assign->exp);
+        }
+        else if (auto d = dynamic_cast<const DefAST *>(&s))
+            def(*d);
+        else if (auto if_stmt = dynamic_cast<const IfAST *>(&s))
+        {
+            word("if");
+            exp(*if_stmt->exp);
+            stmt(*if_stmt->then_stmt);
+            if (if_stmt->else_stmt.has_value())
+            {
+                word("else");
+                stmt(*if_stmt->else_stmt.value());
+            }
+        }
+        else if (auto while_stmt = dynamic_cast<const WhileAST *>(&s))
+        {
+            word("while");
+            exp(*while_stmt->exp);
+            stmt(*while_stmt->stmt);
+        }
+        else if (auto control = dynamic_cast<const ControlAST *>(&s))
+            word(control->type);
+        else
+            assert(0);
+    }
+
+    void function(const FuncDefAST &f)
+    {
+        word(f.func_type);
+        name(f.ident);
+        for (auto const &arg : f.args)
+        {
+            name(arg.first);
+            word("[");
+            for (auto const &dim : arg.second)
+                exp(dim);
+            word("]");
+        }
+        stmt(*f.block);
+    }
+};
+}
+
+FunctionCache::FunctionCache(const std::string dir, const std::string mode, uint64_t max_bytes, bool lines) : dir(dir), max_bytes(max_bytes), lines(lines)
+{
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (!fs::is_directory(dir, ec))
+    {
+        logger(LogLevel::WARN) << "cannot use cache directory " << dir << ", caching is off" << std::endl;
+        return;
+    }
+    // entries written by a different build of the compiler never match
+    fs::path exe = fs::read_symlink("/proc/self/exe", ec);
+    std::ostringstream stamp;
+    stamp << "sysy-cache 1 " << mode << " " << exe.string() << " " << fs::file_size(exe, ec) << " "
+          << fs::last_write_time(exe, ec).time_since_epoch().count() << "\n";
+    prefix = stamp.str();
+}
+
+std::string FunctionCache::path(const std::string &key) const
+{
+    return dir + "/" + digest(key) + ".fn";
+}
+
+std::vector<std::string> FunctionCache::keys(const CompUnitAST &unit) const
+{
+    // a global's digest covers the globals its declaration names, so a
+    // changed constant also changes everything computed from it
+    std::unordered_map<Symbol, std::string> globals;
+    for (auto const &def : unit.var_def)
+    {
+        Serializer s;
+        s.def(*def);
+        for (auto sym : s.names)
+            if (globals.count(sym))
+                s.word(globals[sym]);
+        globals[def->ident] = digest(s.out);
+    }
+    std::unordered_map<std::string, std::string> func_type(lib_func_type.begin(), lib_func_type.end());
+    for (auto const &func : unit.func_def)
+        func_type[symbol_name(func->ident)] = func->func_type;
+    // what a callee does to the globals a caller names decides which of them
+    // the caller reloads after the call
+    auto effects = unit.global_effects();
+    std::unordered_map<std::string, const GlobalEffects *> func_effects;
+    {
+        unsigned f = 0;
+        for (auto const &func : unit.func_def)
+            func_effects[symbol_name(func->ident)] = &effects[f++];
+    }
+
+    std::vector<std::string> result;
+    for (auto const &func : unit.func_def)
+    {
+        Serializer s;
+        s.lines = lines;
+        s.function(*func);
+        std::vector<std::string> uses;
+        std::vector<Symbol> named;
+        for (auto sym : s.names)
+            if (globals.count(sym))
+            {
+                uses.push_back(symbol_name(sym) + "=" + globals[sym]);
+                named.push_back(sym);
+            }
+        std::sort(named.begin(), named.end());
+        named.erase(std::unique(named.begin(), named.end()), named.end());
+        for (auto const &callee : s.calls)
+        {
+            std::string use = callee + ":" + (func_type.count(callee) ? func_type[callee] : "?");
+            if (func_effects.count(callee))
+                for (auto sym : named)
+                {
+                    auto const &touched = *func_effects[callee];
+                    if (std::binary_search(touched.reads.begin(), touched.reads.end(), sym))
+                        use += "<" + symbol_name(sym);
+                    if (std::binary_search(touched.writes.begin(), touched.writes.end(), sym))
+                        use += ">" + symbol_name(sym);
+                }
+            uses.push_back(use);
+        }
+        std::sort(uses.begin(), uses.end());
+        uses.erase(std::unique(uses.begin(), uses.end()), uses.end());
+        std::string key = prefix + s.out + "\n";
+        for (auto const &use : uses)
+            key += use + " ";
+        result.push_back(std::move(key));
+    }
+    return result;
+}
+
+bool FunctionCache::load(const std::string &key, std::string &text)
+{
+    std::string file = path(key);
+    std::ifstream in(file, std::ios::binary);
+    size_t key_size;
+    if (!(in >> key_size) || in.get() != '\n')
+    {
+        misses++;
+        return false;
+    }
+    std::string stored(key_size, '\0');
+    if (!in.read(&stored[0], key_size) || stored != key)
+    {
+        misses++;
+        return false;
+    }
+    text.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    in.close();
+    // eviction goes by modification time, so a hit marks the entry as used
+    std::error_code ec;
+    fs::last_write_time(file, fs::file_time_type::clock::now(), ec);
+    hits++;
+    return true;
+}
+
+void FunctionCache::store(const std::string &key, const std::string &text)
+{
+    // written aside and renamed into place, so readers never see half an entry
+    std::string file = path(key);
+    std::string tmp = file + ".tmp" + std::to_string(getpid()) + "_" + std::to_string(tmp_count++);
+    uint64_t size;
+    {
+        std::ofstream out(tmp, std::ios::binary);
+        out << key.size() << "\n" << key << text;
+        size = out.tellp();
+        if (!out)
+        {
+            logger(LogLevel::WARN) << "cannot write cache entry " << tmp << std::endl;
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmp, file, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+    else
+        stores++, stored_bytes += size;
+}
+
+void FunctionCache::evict()
+{
+    // The size of the entries is kept in an index file, locked while it
+    // changes, so a compile reads and writes one number instead of walking
+    // the directory. An entry stored over an older one is counted twice;
+    // that only brings the next scan, which sets the exact size, forward.
+    int fd = open((dir + "/size").c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return;
+    flock(fd, LOCK_EX);
+    char buf[32];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    bool known = n > 0;
+    buf[known ? n : 0] = '\0';
+    total_bytes = strtoull(buf, nullptr, 10) + stored_bytes;
+    if (stores && (!known || total_bytes > max_bytes))
+    {
+        struct Entry
+        {
+            fs::path path;
+            uint64_t size;
+            fs::file_time_type time;
+        };
+        std::vector<Entry> entries;
+        std::error_code ec;
+        total_bytes = 0;
+        for (auto const &it : fs::directory_iterator(dir, ec))
+        {
+            if (it.path().extension() != ".fn")
+                continue;
+            Entry entry = {it.path(), it.file_size(ec), it.last_write_time(ec)};
+            if (ec)
+                continue;
+            total_bytes += entry.size;
+            entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) { return a.time < b.time; });
+        for (auto const &entry : entries)
+        {
+            if (total_bytes <= max_bytes)
+                break;
+            if (fs::remove(entry.path, ec))
+                total_bytes -= entry.size, evicted++;
+        }
+    }
+    if (stores)
+    {
+        std::string size = std::to_string(total_bytes) + "\n";
+        if (ftruncate(fd, 0) < 0 || pwrite(fd, size.data(), size.size(), 0) < 0)
+            logger(LogLevel::WARN) << "cannot update " << dir << "/size" << std::endl;
+    }
+    close(fd);
+}
+
+void FunctionCache::print_stats(std::ostream &out) const
+{
+    out << "function cache: " << hits << " hits, " << misses << " misses, " << stores << " stored, "
+        << evicted << " evicted, " << total_bytes / 1024 << " KB in " << dir << std::endl;
+}
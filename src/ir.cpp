@@ -1,12 +1,43 @@
 #include <ir.h>
 #include <str.h>
+#include <timer.h>
+#include <cache.h>
 #include <cassert>
 #include <iostream>
-#include <queue>
 #include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
-const std::unordered_set<std::string> op_name = {"add", "sub", "mul", "div", "mod", "and", "or", "eq", "ne", "lt", "gt", "le", "ge"};
-const std::unordered_set<std::string> end_of_block = {"br", "jump", "ret"};
+const IROPINFO irop_info[static_cast<int>(IROP::COUNT)] = {
+    // name, riscv_name, arity, binary, terminator, has_result, commutative
+    {"add", "add", 3, true, false, true, true},
+    {"sub", "sub", 3, true, false, true, false},
+    {"mul", "mul", 3, true, false, true, true},
+    {"div", "div", 3, true, false, true, false},
+    {"mod", "rem", 3, true, false, true, false},
+    {"and", "and", 3, true, false, true, true},
+    {"or", "or", 3, true, false, true, true},
+    {"xor", "xor", 3, true, false, true, true},
+    {"eq", "xor", 3, true, false, true, true},
+    {"ne", "xor", 3, true, false, true, true},
+    {"lt", "slt", 3, true, false, true, false},
+    {"gt", "sgt", 3, true, false, true, false},
+    {"le", "sgt", 3, true, false, true, false},
+    {"ge", "slt", 3, true, false, true, false},
+    {"alloc", "", 2, false, false, true, false},
+    {"global alloc", "", 3, false, false, true, false},
+    {"load", "", 2, false, false, true, false},
+    {"store", "", 2, false, false, false, false},
+    {"getptr", "", 3, false, false, true, false},
+    {"getelemptr", "", 3, false, false, true, false},
+    {"call", "call", -1, false, false, true, false},
+    {"call", "call", -1, false, false, false, false},
+    {"br", "", 3, false, true, false, false},
+    {"jump", "j", 1, false, true, false, false},
+    {"ret", "ret", -1, false, true, false, false},
+    {"//!", "", -1, false, false, false, false},
+};
 const std::unordered_map<std::string, std::string> lib_func_type = {
     {"getint", "int"},
     {"getch", "int"},
@@ -28,6 +59,27 @@ const std::unordered_map<std::string, std::string> lib_func_decl = {
     {"stoptime", "decl @stoptime()"},
 };
 
+IROP irop_from_name(const std::string &name)
+{
+    static const std::unordered_map<std::string, IROP> names = []()
+    {
+        std::unordered_map<std::string, IROP> result;
+        for (int i = 0; i < static_cast<int>(IROP::COUNT); i++)
+            result.insert({irop_info[i].name, static_cast<IROP>(i)});
+        return result;
+    }();
+    return names.at(name);
+}
+
+static const Symbol sym_zero = intern("0");
+static const Symbol sym_i32 = intern("i32");
+static const Symbol sym_undef = intern("undef");
+static const Symbol sym_decl = intern("decl");
+static const Symbol sym_note = intern("//!");
+static const Symbol sym_disgard = intern("disgard");
+static const Symbol sym_entry = intern("\%entry");
+const Symbol init_sym = intern("!init");
+
 int get_type_size(const std::string type)
 {
     if (type == "i32")
@@ -47,72 +99,81 @@ int getlog(int x)
 IRINFO::IRINFO()
 {
     level = 0;
+    pool = std::make_unique<Arena>();
     for (auto const& it : lib_func_type)
-        func_type[it.first] = it.second;
+        func_type[intern(it.first)] = it.second;
 }
 
-std::string IRINFO::get_var_name(const std::string ast_name) const
+std::shared_ptr<IRINFO> IRINFO::fork() const
 {
-    if (is_tvar(ast_name))
-        return ast_name;
-    else
-        return "@" + ast_name + "_" + std::to_string(pvar_stack.at(ast_name).top());
+    auto result = std::make_shared<IRINFO>();
+    result->level = level;
+    result->pvars = pvars;
+    result->func_type = func_type;
+    return result;
 }
 
-std::string IRINFO::allocate_var(const std::string info, const bool temp, const bool var, const bool is_arg, const List<std::optional<unsigned>> dims)
+std::unique_ptr<Arena> IRINFO::take_pool()
 {
-    if (!var)
-    {
-        std::string new_info = (temp ? "temp_" : "alloc_") + info;
-        if (tvar_count.find(new_info) == tvar_count.end())
-            tvar_count[new_info] = 0, tvar_last_count[new_info] = 0;
-        std::string var_name = "%" + new_info + "_" + std::to_string(tvar_count[new_info]++);
-        tvar_time[var_name] = time++;
-        return var_name;
-    }
-    else
-    {
-        if (!pvar_count.count(info))
-        {
-            pvar_count[info] = 0;
-            pvar_alloc[info] = std::unordered_set<unsigned>();
-            pvar_stack[info] = std::stack<unsigned>();
-            pvar_const[info] = std::unordered_map<unsigned, std::optional<std::string>>();
-            pvar_level[info] = std::unordered_map<unsigned, unsigned>();
-            pvar_is_arg[info] = std::unordered_map<unsigned, bool>();
-            pvar_type[info] = std::unordered_map<unsigned, List<std::optional<unsigned>>>();
-        }
-        pvar_alloc[info].insert(pvar_count[info]);
-        pvar_stack[info].push(pvar_count[info]);
-        pvar_const[info][pvar_count[info]] = std::nullopt;
-        pvar_level[info][pvar_count[info]] = level;
-        pvar_is_arg[info][pvar_count[info]] = is_arg;
-        pvar_type[info][pvar_count[info]] = List<std::optional<unsigned>>();
-        if (!dims.empty())
-            for (auto const& dim : dims)
-                pvar_type[info][pvar_count[info]].push_back(dim);
-        std::string var_name = "@" + info + "_" + std::to_string(pvar_count[info]++);
-        return var_name;
-    }
+    auto result = std::move(pool);
+    pool = std::make_unique<Arena>();
+    return result;
 }
 
-std::string IRINFO::allocate_label(const std::string info)
+arena_ptr<ValueIR> IRINFO::new_value(IROP op) const
 {
-    if (label_count.find(info) == label_count.end())
-        label_count[info] = 0;
-    std::string label_name = "\%label_" + info + "_" + std::to_string(label_count[info]++);
-    return label_name;
+    auto value = make_arena<ValueIR>(*pool, *pool, op);
+    value->line = line;
+    return value;
 }
 
-void IRINFO::set_const(const std::string& name, const std::string& value)
+Symbol IRINFO::get_var_name(const Symbol ident) const
 {
-    pvar_const[name][pvar_stack[name].top()] = value;
+    return lookup(ident).name;
 }
 
-std::optional<std::string> IRINFO::get_const(const std::string& name) const
+Symbol IRINFO::allocate_var(const std::string info, const bool temp)
 {
-    std::string ident = name.substr(1, name.rfind("_") - 1);
-    return pvar_const.at(ident).at(pvar_stack.at(ident).top());
+    std::string new_info = (temp ? "temp_" : "alloc_") + info;
+    Symbol var_name = intern("%" + new_info + "_" + std::to_string(tvar_count[new_info]++));
+    tvars.push_back(var_name);
+    return var_name;
+}
+
+Symbol IRINFO::define_var(const Symbol ident, const bool is_arg, const List<std::optional<unsigned>> dims)
+{
+    if (ident >= pvars.size())
+        pvars.resize(ident + 1);
+    auto& sym = pvars[ident];
+    unsigned count = sym.defs.size();
+    Symbol var_name = intern("@" + symbol_name(ident) + "_" + std::to_string(count));
+    pvar_alloc.push_back({ident, count});
+    sym.stack.push_back(count);
+    sym.defs.push_back({var_name, std::nullopt, (unsigned)level, is_arg, std::vector<std::optional<unsigned>>(dims.begin(), dims.end())});
+    scope_log.push_back(ident);
+    return var_name;
+}
+
+Symbol IRINFO::allocate_label(const std::string info)
+{
+    return intern("\%label_" + info + "_" + std::to_string(label_count[info]++));
+}
+
+const PVARINFO& IRINFO::lookup(const Symbol ident) const
+{
+    auto& sym = pvars.at(ident);
+    return sym.defs[sym.stack.back()];
+}
+
+void IRINFO::set_const(const Symbol ident, const Symbol value)
+{
+    auto& sym = pvars.at(ident);
+    sym.defs[sym.stack.back()].const_value = value;
+}
+
+std::optional<Symbol> IRINFO::get_const(const Symbol ident) const
+{
+    return lookup(ident).const_value;
 }
 
 std::unique_ptr<PartIR> IRINFO::get_alloc(std::weak_ptr<IRINFO> info) const
@@ -120,108 +181,92 @@ std::unique_ptr<PartIR> IRINFO::get_alloc(std::weak_ptr<IRINFO> info) const
     auto ir = std::make_unique<PartIR>();
     for (auto const& it : pvar_alloc)
     {
-        for (auto const& it2 : it.second)
+        auto& def = pvars[it.first].defs[it.second];
+        if (def.level <= 1 || def.const_value.has_value() || def.is_arg)
+            continue;
+        auto value = new_value(IROP::ALLOC);
+        value->args = {def.name};
+        if (def.type.empty())
+            value->args.push_back(sym_i32);
+        else
         {
-            int level = pvar_level.at(it.first).at(it2);
-            if (level <= 1 || pvar_const.at(it.first).at(it2).has_value() || pvar_is_arg.at(it.first).at(it2))
-                continue;
-            auto value = std::make_unique<ValueIR>();
-            value->op = "alloc";
-            value->args = {"@" + it.first + "_" + std::to_string(it2)};
-            if (pvar_type.at(it.first).at(it2).empty())
-                value->args.push_back("i32");
-            else
-            {
-                int size = 1;
-                for (auto const& dim : pvar_type.at(it.first).at(it2))
-                    size *= dim.value();
-                value->args.push_back("[i32, " + std::to_string(size) + "]");
-            }
-            ir->append(std::move(value), info);
+            int size = 1;
+            for (auto const& dim : def.type)
+                size *= dim.value();
+            value->args.push_back(intern("[i32, " + std::to_string(size) + "]"));
         }
+        ir->append(std::move(value), info);
     }
-    std::vector<std::pair<unsigned, std::unique_ptr<ValueIR>>> tvar_decls;
-    for (auto const& it : tvar_count)
+    for (auto const& var_name : tvars)
     {
-        if (!is_allocvar("%" + it.first))
-            for (int i = tvar_last_count.at(it.first); i < it.second; i++)
-            {
-                auto value = std::make_unique<ValueIR>();
-                std::string var_name = "%" + it.first + "_" + std::to_string(i);
-                value->op = "//!", value->args = {"decl", var_name, "i32"};
-                tvar_decls.push_back({tvar_time.at(var_name), std::move(value)});
-            }
+        if (!symbol_info(var_name).is_allocvar)
+        {
+            auto value = new_value(IROP::NOTE);
+            value->args = {sym_decl, var_name, sym_i32};
+            ir->append(std::move(value), info);
+        }
         else
-            for (int i = tvar_last_count.at(it.first); i < it.second; i++)
-            {
-                auto value = std::make_unique<ValueIR>();
-                std::string var_name = "%" + it.first + "_" + std::to_string(i);
-                value->op = "alloc", value->args = {var_name, "i32"};
-                tvar_decls.push_back({tvar_time.at(var_name), std::move(value)});
-            }
+        {
+            auto value = new_value(IROP::ALLOC);
+            value->args = {var_name, sym_i32};
+            ir->append(std::move(value), info);
+        }
     }
-    std::sort(tvar_decls.begin(), tvar_decls.end());
-    for (auto& it : tvar_decls)
-        ir->append(std::move(it.second), info);
     return ir;
 }
 
-void IRINFO::set_func(const std::string& name, const std::string& type)
+void IRINFO::set_func(const Symbol name, const std::string& type)
 {
     func_type[name] = type;
 }
 
-std::string IRINFO::get_func(const std::string& name) const
+std::string IRINFO::get_func(const Symbol name) const
 {
     return func_type.at(name);
 }
 
-std::vector<std::optional<unsigned>> IRINFO::get_type(const std::string& name) const
+std::vector<std::optional<unsigned>> IRINFO::get_type(const Symbol ident) const
 {
-    std::string ident = name[0] == '@' ? name.substr(1, name.rfind("_") - 1) : name;
-    auto result_list = pvar_type.at(ident).at(pvar_stack.at(ident).top());
-    auto result_vector = std::vector<std::optional<unsigned>>();
-    for (auto const& result : result_list)
-        result_vector.push_back(result);
-    return result_vector;
+    return lookup(ident).type;
 }
 
-bool IRINFO::is_arg(const std::string& name) const
+bool IRINFO::is_arg(const Symbol ident) const
 {
-    std::string ident = name[0] == '@' ? name.substr(1, name.rfind("_") - 1) : name;
-    return pvar_is_arg.at(ident).at(pvar_stack.at(ident).top()) && !pvar_type.at(ident).at(pvar_stack.at(ident).top()).empty();
+    auto& def = lookup(ident);
+    return def.is_arg && !def.type.empty();
 }
 
 void IRINFO::inc_level()
 {
     level++;
+    scope_marks.push_back(scope_log.size());
 }
 
 void IRINFO::dec_level()
 {
-    for (auto& it : pvar_stack)
-        if (it.second.size() && pvar_level[it.first][it.second.top()] == level)
-            it.second.pop();
+    for (size_t i = scope_marks.back(); i < scope_log.size(); i++)
+        pvars[scope_log[i]].stack.pop_back();
+    scope_log.resize(scope_marks.back());
+    scope_marks.pop_back();
     level--;
 }
 
-std::unique_ptr<PartIR> IRINFO::start_func(const List<std::pair<std::string, List<std::optional<unsigned>>>>& args, std::vector<std::string>& result, std::weak_ptr<IRINFO> info)
+std::unique_ptr<PartIR> IRINFO::start_func(const List<std::pair<Symbol, List<std::optional<unsigned>>>>& args, std::vector<std::string>& result, std::weak_ptr<IRINFO> info)
 {
-    time = 0;
     std::unique_ptr<PartIR> ir = std::make_unique<PartIR>();
     for (auto const& arg : args)
     {
-        std::string pname = allocate_var(arg.first, false, true, true, arg.second); 
-        std::string tname = arg.second.empty() ? "\%arg_" + pname.substr(1) : pname;
+        Symbol pname = define_var(arg.first, true, arg.second);
+        std::string tname = arg.second.empty() ? "\%arg_" + symbol_name(pname).substr(1) : symbol_name(pname);
         std::string type = arg.second.empty() ? "i32" : "*i32";
         result.push_back(tname + ": " + type);
         if (!arg.second.empty())
             continue;
-        auto value = std::make_unique<ValueIR>();
-        value->op = "alloc", value->args = {pname, type, "//!", "disgard"};
+        auto value = new_value(IROP::ALLOC);
+        value->args = {pname, intern(type), sym_note, sym_disgard};
         ir->append(std::move(value), info);
-        auto value2 = std::make_unique<ValueIR>();
-        value2->op = "store", value2->args = {tname, pname, "//!", "disgard"};
+        auto value2 = new_value(IROP::STORE);
+        value2->args = {intern(tname), pname, sym_note, sym_disgard};
         ir->append(std::move(value2), info);
     }
     return ir;
@@ -229,10 +274,15 @@ std::unique_ptr<PartIR> IRINFO::start_func(const List<std::pair<std::string, Lis
 
 void IRINFO::end_func()
 {
+    // forget the function's definitions and counters, so the names in the
+    // next function do not depend on which functions came before it
+    for (auto it = pvar_alloc.rbegin(); it != pvar_alloc.rend(); it++)
+        pvars[it->first].defs.resize(it->second);
     pvar_alloc.clear();
-    tvar_time.clear();
-    for (auto& it : tvar_last_count)
-        it.second = tvar_count[it.first];
+    tvars.clear();
+    label_count.clear();
+    tvar_count.clear();
+    loops.clear();
 }
 
 void ProgramIR::to_string(std::string& str, const int tabs) const
@@ -244,64 +294,125 @@ void ProgramIR::to_string(std::string& str, const int tabs) const
         value->to_string(str, tabs);
     new_line(str);
     for (auto const& function : functions)
+    {
+        if (function->cached.has_value())
+        {
+            str += function->cached.value();
+            continue;
+        }
+        size_t start = str.size();
         function->to_string(str, tabs);
+        if (!function->cache_key.empty())
+            function_cache->store(function->cache_key, str.substr(start));
+    }
 }
 
-void ValueIR::to_string(std::string& str, const int tabs) const
+void InitIR::to_string(std::string& str) const
 {
-
-    std::string instruciton = op;
-    if (op_name.count(op))
-        instruciton = args[0] + " = " + op + " " + args[1] + ", " + args[2];
-    else if (op == "alloc" || op == "load")
-        instruciton = args[0] + " = " + op + " " + args[1];
-    else if (op == "global alloc")
+    str += "{";
+    auto it = values.begin();
+    for (unsigned i = 0; i < size; i++)
     {
-        instruciton = "global " + args[0] + " = alloc " + args[1] + ", " + args[2];
+        if (i)
+            str += ", ";
+        if (it != values.end() && it->first == i)
+            str += it->second.has_value() ? symbol_name(it->second.value()) : "undef", it++;
+        else
+            str += "0";
     }
-    else if (op == "call_int")
+    str += "}";
+}
+
+void ValueIR::to_string(std::string& str, const int tabs) const
+{
+    const IROPINFO &op_info = get_irop_info(op);
+    std::string init_str;
+    if (init)
+        init->to_string(init_str);
+    auto arg = [&](int i) -> const std::string& { return args[i] == init_sym ? init_str : symbol_name(args[i]); };
+    // a jump target with the arguments for its block parameters
+    auto target = [&](int i, int k)
     {
-        instruciton = args[1] + " = call @" + args[0] + "(";
+        std::string result = arg(i);
+        if (!edge_args->args[k].empty())
+        {
+            result += "(";
+            for (unsigned j = 0; j < edge_args->args[k].size(); j++)
+            {
+                if (j)
+                    result += ", ";
+                result += symbol_name(edge_args->args[k][j]);
+            }
+            result += ")";
+        }
+        return result;
+    };
+    std::string instruciton = op_info.name;
+    switch (op)
+    {
+    case IROP::ALLOC:
+    case IROP::LOAD:
+        instruciton = arg(0) + " = " + op_info.name + " " + arg(1);
+        break;
+    case IROP::GLOBAL_ALLOC:
+        instruciton = "global " + arg(0) + " = alloc " + arg(1) + ", " + arg(2);
+        break;
+    case IROP::CALL_INT:
+        instruciton = arg(1) + " = call @" + arg(0) + "(";
         for (int i = 2; i < args.size(); i++)
         {
             if (i > 2)
                 instruciton += ", ";
-            instruciton += args[i];
+            instruciton += arg(i);
         }
         instruciton += ")";
-    }
-    else if (op == "call_void")
-    {
-        instruciton = "call @" + args[0] + "(";
+        break;
+    case IROP::CALL_VOID:
+        instruciton = "call @" + arg(0) + "(";
         for (int i = 1; i < args.size(); i++)
         {
             if (i > 1)
                 instruciton += ", ";
-            instruciton += args[i];
+            instruciton += arg(i);
         }
         instruciton += ")";
-    }
-    else if (op == "getelemptr" || op == "getptr")
-        instruciton = args[0] + " = " + op + " " + args[1] + ", " + args[2];
-    else
-    {
-        for (int i = 0; i < args.size(); i++)
+        break;
+    case IROP::GETPTR:
+    case IROP::GETELEMPTR:
+        instruciton = arg(0) + " = " + op_info.name + " " + arg(1) + ", " + arg(2);
+        break;
+    case IROP::JUMP:
+    case IROP::BR:
+        if (edge_args)
         {
-            if (i && args[i] != "//!")
-                instruciton += ",";
-            instruciton += " ";
-            instruciton += args[i];
+            if (op == IROP::JUMP)
+                instruciton += " " + target(0, 0);
+            else
+                instruciton += " " + arg(0) + ", " + target(1, 0) + ", " + target(2, 1);
+            break;
         }
+        [[fallthrough]];
+    default:
+        if (op_info.binary)
+            instruciton = arg(0) + " = " + op_info.name + " " + arg(1) + ", " + arg(2);
+        else
+            for (int i = 0; i < args.size(); i++)
+            {
+                if (i && args[i] != sym_note)
+                    instruciton += ",";
+                instruciton += " ";
+                instruciton += arg(i);
+            }
     }
     if (instruciton.find("//!") == std::string::npos)
     {
         for (int i = 0; i < args.size(); i++)
         {
-            if (args[i] == "//!")
+            if (args[i] == sym_note)
             {
                 instruciton += " //!";
                 for (int j = i + 1; j < args.size(); j++)
-                    instruciton += " " + args[j];
+                    instruciton += " " + arg(j);
             }
         }
     }
@@ -331,7 +442,19 @@ void FunctionIR::to_string(std::string& str, const int tabs) const
 
 void BaseBlockIR::to_string(std::string& str, const int tabs) const
 {
-    new_line(str, name + ":", tabs);
+    std::string label = symbol_name(name);
+    if (!params.empty())
+    {
+        label += "(";
+        for (unsigned i = 0; i < params.size(); i++)
+        {
+            if (i)
+                label += ", ";
+            label += symbol_name(params[i]) + ": i32";
+        }
+        label += ")";
+    }
+    new_line(str, label + ":", tabs);
     for (auto const& value : values)
         value->to_string(str, tabs + 1);
 }
@@ -341,169 +464,343 @@ void PartIR::to_string(std::string& str, const int tabs) const
 {
     std::cout<<"values:"<<std::endl;
     for (auto const& value : values)
-        std::cout<<"\t"<<value->op<<std::endl;
+        std::cout<<"\t"<<get_irop_info(value->op).name<<std::endl;
     std::cout<<std::endl;
     std::cout<<"blocks:"<<std::endl;
     for (auto const& block : blocks)
     {
-        std::cout<<"\t"<<block->name<<std::endl;
+        std::cout<<"\t"<<symbol_name(block->name)<<std::endl;
         for (auto const& value : block->values)
-            std::cout<<"\t\t"<<value->op<<std::endl;
+            std::cout<<"\t\t"<<get_irop_info(value->op).name<<std::endl;
     }
     std::cout<<std::endl;
     if (new_values.has_value())
     {
-        std::cout<<"new_values: "<<new_values.value().second<<std::endl;
+        std::cout<<"new_values: "<<symbol_name(new_values.value().second)<<std::endl;
         for (auto const& value : new_values.value().first)
-            std::cout<<"\t"<<value->op<<std::endl;
+            std::cout<<"\t"<<get_irop_info(value->op).name<<std::endl;
     }
     std::cout<<std::endl;
 }
 
+// the function's assembly, taken from the function cache when it is there
+static std::string lower_function(FunctionIR &function, Controller &cont)
+{
+    if (function.cached.has_value())
+        return std::move(function.cached.value());
+    RISCV buffer;
+    function.to_riscv(buffer, cont);
+    std::string text = buffer.take();
+    if (!function.cache_key.empty())
+        function_cache->store(function.cache_key, text);
+    return text;
+}
+
 void ProgramIR::to_riscv(RISCV &riscv, Controller &cont)
 {
     cont.set_glob(&global_riscv_info);
+    if (annotation == Annotation::SOURCE)
+    {
+        std::string file;
+        for (char c : annotation_file)
+            file += (c == '"' || c == '\\') ? std::string("\\") + c : std::string(1, c);
+        riscv.text.push_back({".file 1 \"" + file + "\""});
+    }
     riscv.text.push_back({".data"});
     for (auto const &value : values)
     {
-        std::string value_name = value->args[0];
-        std::string riscv_name = "globl_" + value_name.substr(1);
-        global_riscv_info.global_var.insert({value_name, riscv_name});
+        Symbol value_name = value->args[0];
+        std::string riscv_name = "globl_" + symbol_name(value_name).substr(1);
+        global_riscv_info.global_var[value_name] = riscv_name;
         riscv.text.push_back({".globl", riscv_name});
         riscv.text.push_back({riscv_name + ":"});
-        if (value->args[2] == "undef")
-            riscv.text.push_back({".zero", std::to_string(get_type_size(value->args[1]))});
-        else if (value->args[2][0] != '{')
-            riscv.text.push_back({".word", value->args[2]});
+        if (value->args[2] == sym_undef)
+            riscv.text.push_back({".zero", std::to_string(get_type_size(symbol_name(value->args[1])))});
+        else if (!value->init)
+            riscv.text.push_back({".word", symbol_name(value->args[2])});
         else
         {
-            std::string temp = value->args[2].substr(1, value->args[2].size() - 2);
-            int start = 0, end = (temp.find(", ") == std::string::npos) ? temp.size() : temp.find(", ");
-            int zero_num = 0;
-            do
+            // the gaps between listed elements are the zero runs
+            unsigned next = 0;
+            for (auto const &it : value->init->values)
             {
-                auto num = temp.substr(start, end - start);
-                if (num == "0")
-                    zero_num += 4;
-                else
-                {
-                    if (zero_num)
-                    {
-                        riscv.text.push_back({".zero", std::to_string(zero_num)});
-                        zero_num = 0;
-                    }
-                    riscv.text.push_back({".word", temp.substr(start, end - start)});
-                }
-                start = end + 2;
-                end = (temp.find(", ", start) == std::string::npos) ? temp.size() : temp.find(", ", start);
-            } while (start < temp.size());
-            if (zero_num)
-                riscv.text.push_back({".zero", std::to_string(zero_num)});
+                if (it.first > next)
+                    riscv.text.push_back({".zero", std::to_string((it.first - next) * 4)});
+                riscv.text.push_back({".word", it.second.has_value() ? symbol_name(it.second.value()) : "0"});
+                next = it.first + 1;
+            }
+            if (value->init->size > next)
+                riscv.text.push_back({".zero", std::to_string((value->init->size - next) * 4)});
         }
     }
     riscv.text.push_back({""});
     riscv.text.push_back({".text"});
+    riscv.emit();
     for (auto const &it : lib_func_decl)
-        global_riscv_info.func_name.insert({it.first, it.first});
-    global_riscv_info.func_name.insert({"main", "main"});
+        global_riscv_info.func_name[intern(it.first)] = it.first;
+    global_riscv_info.func_name[intern("main")] = "main";
     for (auto const &function : functions)
         if (function->name != "main")
-            global_riscv_info.func_name.insert({function->name, "func_" + function->name});
-    for (auto const& function : functions)
-        function->to_riscv(riscv, cont);
+            global_riscv_info.func_name[intern(function->name)] = "func_" + function->name;
+    unsigned workers = parallel_workers(functions.size());
+    if (workers == 1)
+    {
+        for (auto const& function : functions)
+            riscv.write(lower_function(*function, cont));
+        return;
+    }
+
+    // each worker lowers whole functions with its own Controller into its own
+    // buffer; the buffers are written in source order, and workers stay at
+    // most a few functions ahead of the writer to bound the memory held
+    size_t n = functions.size(), next = 0, written = 0, window = 4 * workers;
+    std::vector<std::optional<std::string>> texts(n);
+    std::mutex mutex;
+    std::condition_variable cv;
+    auto worker = [&]()
+    {
+        Controller worker_cont;
+        worker_cont.set_glob(&global_riscv_info);
+        while (true)
+        {
+            size_t i;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [&]() { return next >= n || next < written + window; });
+                if (next >= n)
+                {
+                    cont.spill_loads += worker_cont.spill_loads;
+                    cont.spill_stores += worker_cont.spill_stores;
+                    return;
+                }
+                i = next++;
+            }
+            std::string text = lower_function(*functions[i], worker_cont);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                texts[i] = std::move(text);
+            }
+            cv.notify_all();
+        }
+    };
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < workers; i++)
+        threads.emplace_back(worker);
+    while (written < n)
+    {
+        std::string text;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&]() { return texts[written].has_value(); });
+            text = std::move(texts[written].value());
+            texts[written].reset();
+        }
+        riscv.write(text);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            written++;
+        }
+        cv.notify_all();
+    }
+    for (auto &thread : threads)
+        thread.join();
+}
+
+// Copies the arguments of an edge into the parameters of the block it enters,
+// like stores to variables. The copies happen at once: mem2reg has copied
+// aside any argument that names an earlier parameter, but the allocator may
+// give a parameter the register of an argument read after it. So a copy waits
+// while another still reads its destination, and a cycle goes through t6.
+static void pass_block_args(const IRArgs &args, const Symbol target, RISCV &riscv, Controller &cont)
+{
+    auto const &params = cont.get_cfg().blocks[cont.get_cfg().id(target)]->params;
+    auto same_place = [&](Symbol a, Symbol b) { return a == b || (cont.pinned_reg(a) >= 0 && cont.pinned_reg(a) == cont.pinned_reg(b)); };
+    std::vector<std::pair<Symbol, Symbol>> copies;
+    for (unsigned i = 0; i < args.size(); i++)
+        if (!same_place(args[i], params[i]))
+            copies.push_back({params[i], args[i]});
+    while (!copies.empty())
+    {
+        size_t i = 0;
+        for (; i < copies.size(); i++)
+        {
+            bool read = false;
+            for (size_t j = 0; j < copies.size() && !read; j++)
+                read = j != i && same_place(copies[j].second, copies[i].first);
+            if (!read)
+                break;
+        }
+        if (i == copies.size())
+        {
+            Symbol src = copies[0].second;
+            riscv.text.push_back({"mv", "t6", reg_names[cont.load(src, riscv)]});
+            for (auto &copy : copies)
+                if (same_place(copy.second, src))
+                    copy.second = t6_sym;
+            continue;
+        }
+        int reg = cont.load(copies[i].first, riscv, false);
+        if (symbol_info(copies[i].second).is_num)
+            riscv.text.push_back({"li", reg_names[reg], symbol_name(copies[i].second)});
+        else
+        {
+            int reg1 = cont.load(copies[i].second, riscv);
+            riscv.text.push_back({"mv", reg_names[reg], reg_names[reg1]});
+        }
+        copies.erase(copies.begin() + i);
+    }
 }
 
 void ValueIR::to_riscv(RISCV &riscv, Controller &cont)
 {
-    std::string ir = "#  ";
-    this->to_string(ir);
-    riscv.text.push_back({ir.substr(0, ir.size() - 1) + ":"});
-    if (!args.empty() && args[args.size() - 1] == "disgard")
+    if (annotation == Annotation::IR)
+    {
+        std::string ir = "#  ";
+        this->to_string(ir);
+        riscv.text.push_back({ir.substr(0, ir.size() - 1) + ":"});
+    }
+    else if (annotation == Annotation::SOURCE)
+        cont.mark_line(line, riscv);
+    if (!args.empty() && args[args.size() - 1] == sym_disgard)
         return;
-    if (op == "ret")
+    switch (op)
+    {
+    case IROP::RET:
     {
         if (args.size())
         {
             cont.save_back(A0_REG, riscv);
-            if (is_var(args[0]))
+            if (symbol_info(args[0]).is_var)
                 cont.load(args[0], riscv, true, A0_REG);
             else
-                riscv.text.push_back({"li", "a0", args[0]});
+                riscv.text.push_back({"li", "a0", symbol_name(args[0])});
         }
         cont.refresh(riscv, false);
         cont.prepare_return(riscv);
         riscv.text.push_back({"lw", "ra", "-4(fp)"});
-        riscv.text.push_back({"lw", "t6", "0(sp)"});
+        riscv.text.push_back({"lw", "t6", "-" + std::to_string(FP_SAVE_POS) + "(fp)"});
         riscv.text.push_back({"mv", "sp", "fp"});
         riscv.text.push_back({"mv", "fp", "t6"});
         riscv.text.push_back({"ret"});
+        break;
     }
-    else if (op == "alloc")
-        cont.alloc(args[0], riscv, true, get_type_size(args[1]));
-    else if (op == "br")
+    case IROP::ALLOC:
+        cont.alloc(args[0], riscv, true, get_type_size(symbol_name(args[1])));
+        break;
+    case IROP::BR:
     {
         int reg;
-        if (is_var(args[0]))
+        if (symbol_info(args[0]).is_var)
             reg = cont.load(args[0], riscv);
         else
-            riscv.text.push_back({"li", "t6", args[0]}), reg = T6_REG;
+            riscv.text.push_back({"li", "t6", symbol_name(args[0])}), reg = T6_REG;
         cont.try_invalidate(args[0]);
+        if (!edge_args || (edge_args->args[0].empty() && edge_args->args[1].empty()))
+            cont.leave_block();
         cont.refresh(riscv); 
-        std::string temp_label = "labellongjump_" + std::to_string(cont.long_jump++);
-        riscv.text.push_back({"bnez", reg_names[reg], temp_label});
-        riscv.text.push_back({"j", args[2].substr(1)});
-        riscv.text.push_back({temp_label + ":"});
-        riscv.text.push_back({"j", args[1].substr(1)});
+        // an edge that passes no block arguments is the branch itself; the
+        // code of the others sits between the branch and its jump.
+        // Controller::relax_branches then drops jumps that fall through
+        std::string true_label = cont.block_label(symbol_name(args[1]).substr(1));
+        std::string false_label = cont.block_label(symbol_name(args[2]).substr(1));
+        riscv.text.push_back({"bnez", reg_names[reg], true_label});
+        auto branch = std::prev(riscv.text.end());
+        if (edge_args)
+            pass_block_args(edge_args->args[1], args[2], riscv, cont), cont.refresh(riscv);
+        bool false_code = std::prev(riscv.text.end()) != branch;
+        riscv.text.push_back({"j", false_label});
+        auto false_jump = std::prev(riscv.text.end());
+        if (edge_args)
+            pass_block_args(edge_args->args[0], args[1], riscv, cont), cont.refresh(riscv);
+        if (std::prev(riscv.text.end()) == false_jump)
+            break;
+        if (!false_code)
+        {
+            *branch = {"beqz", reg_names[reg], false_label};
+            riscv.text.erase(false_jump);
+        }
+        else
+        {
+            std::string temp_label = cont.new_label("labelbranch");
+            branch->back() = temp_label;
+            riscv.text.insert(std::next(false_jump), {temp_label + ":"});
+        }
+        riscv.text.push_back({"j", true_label});
+        break;
     }
-    else if (op == "jump")
-    {
+    case IROP::JUMP:
+        if (edge_args)
+            pass_block_args(edge_args->args[0], args[0], riscv, cont);
+        else
+            cont.leave_block();
+        // the block arguments are in place, nothing reads them after
+        cont.done_reading();
         cont.refresh(riscv);
-        if (cont.has_set_label(args[0].substr(1)) || !start_with(args[0].substr(1), "label_while_cond"))
-            riscv.text.push_back({"j", args[0].substr(1)});
+        if (cont.has_set_label(args[0]) || !cont.get_cfg().is_loop_header(args[0]))
+            riscv.text.push_back({"j", cont.block_label(symbol_name(args[0]).substr(1))});
         else
-            riscv.text.push_back({"j", args[0].substr(1)+"_prepare"});
-    }
-    else if (start_with(op, "call"))
+            riscv.text.push_back({"j", cont.block_label(symbol_name(args[0]).substr(1) + "_prepare")});
+        break;
+    case IROP::CALL_INT:
+    case IROP::CALL_VOID:
     {
-        int with_return = (op == "call_int");
+        int with_return = get_irop_info(op).has_result;
         int arg_num = args.size() - 1 - with_return;
         int pad_num = (4 - (arg_num % 4)) % 4;
-        int size_need = (arg_num + pad_num) * 4;
-        riscv.text.push_back({"li", "t6", std::to_string(size_need)});
-        riscv.text.push_back({"sub", "sp", "sp", "t6"});
+        // only the arguments past the eighth go on the stack; the callee
+        // spills the others to the bottom of this frame
+        int size_need = arg_num > 8 ? (arg_num + pad_num) * 4 : 0;
+        if (!size_need)
+            cont.reserve_out_args(arg_num * 4);
+        else
+        {
+            riscv.text.push_back({"li", "t6", std::to_string(size_need)});
+            riscv.text.push_back({"sub", "sp", "sp", "t6"});
+        }
         std::string func_name = cont.get_glob()->func_name.at(args[0]);
         for (int i = 0; i < std::min(8, arg_num); i++)
         {
-            if (is_num(args[i + 1 + with_return]))
-                cont.save_back(A0_REG + i, riscv, true), riscv.text.push_back({"li", "a" + std::to_string(i), args[i + 1 + with_return]});
+            if (symbol_info(args[i + 1 + with_return]).is_num)
+                cont.save_back(A0_REG + i, riscv, true), riscv.text.push_back({"li", "a" + std::to_string(i), symbol_name(args[i + 1 + with_return])});
             else
                 cont.load(args[i + 1 + with_return], riscv, true, regname_to_idx("a" + std::to_string(i)));
         }
         for (int i = 8; i < arg_num; i++)
         {
-            if (is_num(args[i + 1 + with_return]))
-                riscv.text.push_back({"li", "t6", args[i + 1 + with_return]});
+            if (symbol_info(args[i + 1 + with_return]).is_num)
+                riscv.text.push_back({"li", "t6", symbol_name(args[i + 1 + with_return])});
             else
                 cont.load(args[i + 1 + with_return], riscv, true, T6_REG);
             safe_mem("sw", "t6", -(i - 8) * 4, riscv, "sp");
         }
         for (int i=0;i<arg_num;i++)
             cont.try_invalidate(args[i + 1 + with_return]);
+        // only what is read after the call is stored around it
+        cont.done_reading();
         cont.refresh(riscv, true);
-        cont.transition(riscv, "sw");
+        cont.transition(riscv, "sw", args[0]);
         riscv.text.push_back({"call", func_name});
-        riscv.text.push_back({"li", "t6", std::to_string(size_need)});
-        riscv.text.push_back({"add", "sp", "sp", "t6"});
-        cont.transition(riscv, "lw");
+        if (size_need)
+        {
+            riscv.text.push_back({"li", "t6", std::to_string(size_need)});
+            riscv.text.push_back({"add", "sp", "sp", "t6"});
+        }
+        cont.transition(riscv, "lw", args[0]);
         cont.refresh(riscv);
-        if (with_return)
+        // a result the super block keeps in a saved register, or one with a
+        // register of its own, goes there
+        if (with_return && (cont.current_save.count(args[1]) || cont.pinned_reg(args[1]) >= 0))
+            riscv.text.push_back({"mv", reg_names[cont.load(args[1], riscv, false)], "a0"});
+        else if (with_return)
             cont.bind("a0", args[1]);
+        break;
     }
-    else if (op == "getptr" || op == "getelemptr")
+    case IROP::GETPTR:
+    case IROP::GETELEMPTR:
     {
-        cont.ptr.insert(args[0]);
-        if (is_num(args[2]))
-            riscv.text.push_back({"li", "t6", std::to_string(std::stoi(args[2]) * 4)});
+        cont.ptr[args[0]] = true;
+        if (symbol_info(args[2]).is_num)
+            riscv.text.push_back({"li", "t6", std::to_string(symbol_info(args[2]).num * 4)});
         else
         {
             int reg = cont.load(args[2], riscv);
@@ -512,7 +809,7 @@ void ValueIR::to_riscv(RISCV &riscv, Controller &cont)
         }
         int target_reg = cont.load(args[0], riscv, false);
         int ptr_reg;
-        if (op == "getptr")
+        if (op == IROP::GETPTR)
             ptr_reg = cont.load(args[1], riscv);
         else if (cont.get_glob()->global_var.count(args[1]))
             riscv.text.push_back({"la", "t5", cont.get_glob()->global_var.at(args[1])}), ptr_reg = T5_REG;
@@ -525,26 +822,28 @@ void ValueIR::to_riscv(RISCV &riscv, Controller &cont)
         }
         riscv.text.push_back({"add", reg_names[target_reg], reg_names[ptr_reg], "t6"});
         cont.try_invalidate(args[2]);
+        break;
     }
-    else if (op == "load")
+    case IROP::LOAD:
     {
         int reg1 = cont.load(args[0], riscv, false);
         int reg2 = cont.load(args[1], riscv);
         if (cont.ptr.count(args[1]))
             riscv.text.push_back({"lw", reg_names[reg1], "0(" + reg_names[reg2] + ")"});
-        else
+        else if (reg1 != reg2)
             riscv.text.push_back({"mv", reg_names[reg1], reg_names[reg2]});
         cont.try_invalidate(args[1]);
+        break;
     }
-    else if (op == "store")
+    case IROP::STORE:
     {
-        if (args[0][0] != '{')
+        if (args[0] != init_sym)
         {
             if (cont.ptr.count(args[1]))
             {
                 int vreg;
-                if (is_num(args[0]))
-                    riscv.text.push_back({"li", "t6", args[0]}), vreg = T6_REG;
+                if (symbol_info(args[0]).is_num)
+                    riscv.text.push_back({"li", "t6", symbol_name(args[0])}), vreg = T6_REG;
                 else
                     vreg = cont.load(args[0], riscv);
                 int reg = cont.load(args[1], riscv);
@@ -553,202 +852,287 @@ void ValueIR::to_riscv(RISCV &riscv, Controller &cont)
             else
             {
                 int reg = cont.load(args[1], riscv, false);
-                if (is_num(args[0]))
-                    riscv.text.push_back({"li", reg_names[reg], args[0]});
+                if (symbol_info(args[0]).is_num)
+                    riscv.text.push_back({"li", reg_names[reg], symbol_name(args[0])});
                 else
                 {
                     int reg1 = cont.load(args[0], riscv);
-                    riscv.text.push_back({"mv", reg_names[reg], reg_names[reg1]});
+                    if (reg != reg1)
+                        riscv.text.push_back({"mv", reg_names[reg], reg_names[reg1]});
                 }
             }
             cont.try_invalidate(args[0]);
         }
         else
         {
-            std::string temp = args[0].substr(1, args[0].size() - 2);
-            int size = 4;
-            for (int i = 0; i < args[0].size(); i++)
-                if (args[0][i] == ',')
-                    size += 4;
-            int start = 0, end = (temp.find(", ") == std::string::npos) ? temp.size() : temp.find(", ");
-            int jump_num = 0;
-
-            riscv.text.push_back({"li", "t6", std::to_string(-cont.get_func()->get_save_pos(args[1]))});
-            riscv.text.push_back({"add", "t6", "t6", "fp"});
-            for (int i = 0; i < size; i += 4)
+            // small arrays are stored element by element; larger ones are
+            // zero-filled by a loop, or copied from a .rodata template when
+            // storing their constants one by one would take more code
+            int pos = cont.get_func()->get_save_pos(args[1]);
+            int size = init->size * 4;
+            int constants = 0;
+            for (auto const &value : init->values)
+                if (value.second.has_value())
+                    constants++;
+            bool unroll = init->size <= INIT_UNROLL_MAX;
+            if (!unroll && constants > INIT_UNROLL_MAX)
+            {
+                std::string data_label = cont.new_label("initdata");
+                cont.rodata.push_back({data_label + ":"});
+                unsigned next = 0;
+                for (auto const &value : init->values)
+                {
+                    if (value.first > next)
+                        cont.rodata.push_back({".zero", std::to_string((value.first - next) * 4)});
+                    cont.rodata.push_back({".word", value.second.has_value() ? symbol_name(value.second.value()) : "0"});
+                    next = value.first + 1;
+                }
+                if (init->size > next)
+                    cont.rodata.push_back({".zero", std::to_string((init->size - next) * 4)});
+
+                std::string loop_label = cont.new_label("labelinit");
+                int end_reg = cont.borrow(riscv), value_reg = cont.borrow(riscv);
+                riscv.text.push_back({"la", "t5", data_label});
+                riscv.text.push_back({"li", "t6", std::to_string(-pos)});
+                riscv.text.push_back({"add", "t6", "t6", "fp"});
+                riscv.text.push_back({"li", reg_names[end_reg], std::to_string(size)});
+                riscv.text.push_back({"add", reg_names[end_reg], reg_names[end_reg], "t5"});
+                riscv.text.push_back({loop_label + ":"});
+                riscv.text.push_back({"lw", reg_names[value_reg], "0(t5)"});
+                riscv.text.push_back({"sw", reg_names[value_reg], "0(t6)"});
+                riscv.text.push_back({"addi", "t5", "t5", "4"});
+                riscv.text.push_back({"addi", "t6", "t6", "4"});
+                riscv.text.push_back({"blt", "t5", reg_names[end_reg], loop_label});
+                cont.give_back(end_reg);
+                cont.give_back(value_reg);
+            }
+            else
             {
-                std::string num = temp.substr(start, end - start);
-                if (num != "undef")
+                if (!unroll)
+                {
+                    std::string loop_label = cont.new_label("labelinit");
+                    riscv.text.push_back({"li", "t6", std::to_string(-pos)});
+                    riscv.text.push_back({"add", "t6", "t6", "fp"});
+                    riscv.text.push_back({"li", "t5", std::to_string(size)});
+                    riscv.text.push_back({"add", "t5", "t5", "t6"});
+                    riscv.text.push_back({loop_label + ":"});
+                    riscv.text.push_back({"sw", "zero", "0(t6)"});
+                    riscv.text.push_back({"addi", "t6", "t6", "4"});
+                    riscv.text.push_back({"blt", "t6", "t5", loop_label});
+                }
+                int jump_num = -1;
+                auto store = [&](unsigned index, Symbol num)
                 {
-                    if (jump_num >= IMM12_MAX)
+                    if (jump_num < 0)
                     {
-                        riscv.text.push_back({"li", "t5", std::to_string(jump_num)});
-                        riscv.text.push_back({"add", "t6", "t6", "t5"});
+                        riscv.text.push_back({"li", "t6", std::to_string(-pos)});
+                        riscv.text.push_back({"add", "t6", "t6", "fp"});
                         jump_num = 0;
                     }
+                    if (index * 4 - jump_num >= IMM12_MAX)
+                    {
+                        riscv.text.push_back({"li", "t5", std::to_string(index * 4 - jump_num)});
+                        riscv.text.push_back({"add", "t6", "t6", "t5"});
+                        jump_num = index * 4;
+                    }
                     std::string num_reg;
-                    if (num != "0")
+                    if (num != sym_zero)
                     {
-                        riscv.text.push_back({"li", "t5", num});
+                        riscv.text.push_back({"li", "t5", symbol_name(num)});
                         num_reg = "t5";
                     }
                     else
                         num_reg = "zero";
-                    riscv.text.push_back({"sw", num_reg, std::to_string(jump_num) + "(t6)"});
+                    riscv.text.push_back({"sw", num_reg, std::to_string(index * 4 - jump_num) + "(t6)"});
+                };
+
+                auto it = init->values.begin();
+                for (unsigned i = 0; i < init->size; i++)
+                {
+                    std::optional<Symbol> num = sym_zero;
+                    if (it != init->values.end() && it->first == i)
+                        num = (it++)->second;
+                    else if (!unroll)
+                        continue;
+                    if (num.has_value())
+                        store(i, num.value());
                 }
-                jump_num += 4;
-                start = end + 2;
-                end = (temp.find(", ", start) == std::string::npos) ? temp.size() : temp.find(", ", start);
             }
         }
         cont.try_invalidate(args[1]);
+        break;
     }
-    else if (op_name.count(op))
+    case IROP::NOTE:
+        if (args[0] == sym_decl)
+            cont.alloc(args[1], riscv, false);
+        break;
+    default:
     {
-        std::string lhs, rhs;
+        if (!get_irop_info(op).binary)
+            break;
+        Symbol lhs, rhs;
 
-        if (is_var(args[1]))
+        if (symbol_info(args[1]).is_var)
             lhs = args[1];
         else
-            lhs = "!t6";
+            lhs = t6_sym;
 
-        if (is_var(args[2]))
+        if (symbol_info(args[2]).is_var)
             rhs = args[2];
         else
-            rhs = "!t6";
+            rhs = t6_sym;
 
-        if (op == "sub" && rhs == "!t6" && std::stoi(args[2]) != (1 << 31))
-            op = "add", args[2] = std::to_string(-std::stoi(args[2]));
-        if (op == "add" || op == "or" || op == "xor" || op == "and")
+        if (op == IROP::SUB && rhs == t6_sym && symbol_info(args[2]).num != (1 << 31))
+            op = IROP::ADD, args[2] = intern(std::to_string(-symbol_info(args[2]).num));
+        const IROPINFO &op_info = get_irop_info(op);
+        switch (op)
         {
-            if (lhs == "!t6")
+        case IROP::ADD:
+        case IROP::OR:
+        case IROP::XOR:
+        case IROP::AND:
+            if (lhs == t6_sym)
                 std::swap(lhs, rhs), std::swap(args[1], args[2]);
-            if (is_num(args[2]) && std::stoi(args[2]) >= -IMM12_MAX && std::stoi(args[2]) < IMM12_MAX)
+            if (symbol_info(args[2]).is_num && symbol_info(args[2]).num >= -IMM12_MAX && symbol_info(args[2]).num < IMM12_MAX)
             {
                 int reg = cont.load(args[0], riscv, false);
                 int lreg = cont.load(lhs, riscv);
-                riscv.text.push_back({op + "i", reg_names[reg], reg_names[lreg], args[2]});
+                // a copy between values given the same register
+                if (op != IROP::ADD || args[2] != sym_zero || reg != lreg)
+                    riscv.text.push_back({std::string(op_info.riscv_name) + "i", reg_names[reg], reg_names[lreg], symbol_name(args[2])});
                 cont.try_invalidate(lhs);
                 return;
             }
-        }
-        else if (op == "mul" || op == "div")
-        {
-            if (lhs == "!t6" && op == "mul")
+            break;
+        case IROP::MUL:
+        case IROP::DIV:
+            if (lhs == t6_sym && op_info.commutative)
                 std::swap(lhs, rhs), std::swap(args[1], args[2]);
-            if (is_num(args[2]) && getlog(std::stoi(args[2])) != -1)
+            if (symbol_info(args[2]).is_num && getlog(symbol_info(args[2]).num) != -1)
             {
                 int reg = cont.load(args[0], riscv, false);
                 int lreg = cont.load(lhs, riscv);
-                int log = getlog(std::stoi(args[2]));
+                int log = getlog(symbol_info(args[2]).num);
                 if (log)
                 {
                     riscv.text.push_back({"li", "t6", std::to_string(log)});
-                    riscv.text.push_back({(op == "mul") ? "sll" : "sra", reg_names[reg], reg_names[lreg], "t6"});
+                    riscv.text.push_back({(op == IROP::MUL) ? "sll" : "sra", reg_names[reg], reg_names[lreg], "t6"});
                 }
                 else
                     riscv.text.push_back({"mv", reg_names[reg], reg_names[lreg]});
                 cont.try_invalidate(lhs);
                 return;
             }
-        }
-        else if (op == "eq" || op == "ne")
-        {
-            if (lhs == "!t6")
+            break;
+        case IROP::EQ:
+        case IROP::NE:
+            if (lhs == t6_sym)
                 std::swap(lhs, rhs), std::swap(args[1], args[2]);
-            if (args[2] == "0")
+            if (args[2] == sym_zero)
             {
                 int reg = cont.load(args[0], riscv, false);
                 int lreg = cont.load(lhs, riscv);
-                riscv.text.push_back({"s" + op + "z", reg_names[reg], reg_names[lreg]});
+                riscv.text.push_back({op == IROP::EQ ? "seqz" : "snez", reg_names[reg], reg_names[lreg]});
                 cont.try_invalidate(lhs);
                 return;
             }
+            break;
+        default:
+            break;
         }
 
-        if (lhs == "!t6")
+        if (lhs == t6_sym)
         {
-            if (args[1] == "0")
-                lhs = "!zero";
+            if (args[1] == sym_zero)
+                lhs = zero_sym;
             else
-                riscv.text.push_back({"li", "t6", args[1]});
+                riscv.text.push_back({"li", "t6", symbol_name(args[1])});
         }
-        if (rhs == "!t6")
+        if (rhs == t6_sym)
         {
-            if (args[2] == "0")
-                rhs = "!zero";
+            if (args[2] == sym_zero)
+                rhs = zero_sym;
             else
-                riscv.text.push_back({"li", "t6", args[2]});
-        }
-
-        std::string riscv_op_name;
-        if (op == "mod")
-            riscv_op_name = "rem";
-        else if (op == "lt" || op == "gt")
-            riscv_op_name = "s" + op;
-        else if (op == "eq" || op == "ne")
-            riscv_op_name = "xor";
-        else if (op == "le")
-            riscv_op_name = "sgt";
-        else if (op == "ge")
-            riscv_op_name = "slt";
-        else
-            riscv_op_name = op;
+                riscv.text.push_back({"li", "t6", symbol_name(args[2])});
+        }
+
         int reg = cont.load(args[0], riscv, false);
         int lreg = cont.load(lhs, riscv);
         int rreg = cont.load(rhs, riscv);
-        riscv.text.push_back({riscv_op_name, reg_names[reg], reg_names[lreg], reg_names[rreg]});
+        riscv.text.push_back({op_info.riscv_name, reg_names[reg], reg_names[lreg], reg_names[rreg]});
 
-        if (op == "le" || op == "ge")
+        if (op == IROP::LE || op == IROP::GE)
             riscv.text.push_back({"seqz", reg_names[reg], reg_names[reg]});
-        if (op == "eq" || op == "ne")
-            riscv.text.push_back({"s" + op + "z", reg_names[reg], reg_names[reg]});
+        if (op == IROP::EQ || op == IROP::NE)
+            riscv.text.push_back({op == IROP::EQ ? "seqz" : "snez", reg_names[reg], reg_names[reg]});
         cont.try_invalidate(lhs);
         cont.try_invalidate(rhs);
     }
-    else if (op == "//!")
-    {
-        if (args[0] == "decl")
-            cont.alloc(args[1], riscv, false);
     }
 }
 
 void FunctionIR::to_riscv(RISCV &riscv, Controller &cont)
 {
-    cont.set_func(&func_riscv_info, args);
+    PhaseTimer timer("riscv", &name);
+    cont.set_func(&func_riscv_info, name, args);
+    cont.set_cfg(&cfg);
+    compute_liveness();
     func_riscv_info.init_save_reg();
-    riscv.text.push_back({".globl", cont.get_glob()->func_name.at(name)});
-    riscv.text.push_back({cont.get_glob()->func_name.at(name) + ":"});
+    const std::string &riscv_name = cont.get_glob()->func_name.at(intern(name));
+    riscv.text.push_back({".globl", riscv_name});
+    riscv.text.push_back({riscv_name + ":"});
+    // there is no red zone below sp, so the caller's fp is saved once the frame exists
+    riscv.text.push_back({"mv", "t5", "fp"});
     riscv.text.push_back({"li", "t6"});
     auto sp_it = std::prev(riscv.text.end());
     riscv.text.push_back({"sub", "sp", "sp", "t6"});
-    riscv.text.push_back({"sw", "fp", "0(sp)"});
     riscv.text.push_back({"add", "fp", "sp", "t6"});
+    riscv.text.push_back({"sw", "t5", "-" + std::to_string(FP_SAVE_POS) + "(fp)"});
     riscv.text.push_back({"sw", "ra", "-4(fp)"});
+    cont.pin(pinned, riscv);
     super_block->to_riscv(riscv, cont);
-    int mem_need = ((func_riscv_info.get_mem_need() + 4 + 15) / 16) * 16;
+    int mem_need = ((func_riscv_info.get_mem_need() + func_riscv_info.get_out_args() + 15) / 16) * 16;
     sp_it->push_back(std::to_string(mem_need));
+    cont.relax_branches(riscv);
     riscv.text.push_back({""});
+    if (!cont.rodata.empty())
+    {
+        riscv.text.push_back({".section", ".rodata"});
+        riscv.text.push_back({".p2align", "2"});
+        riscv.text.merge(cont.rodata);
+        riscv.text.push_back({".text"});
+        riscv.text.push_back({""});
+    }
+    riscv.emit();
+    super_block.reset();
+    base_blocks.clear();
+    cfg.clear();
+    pool.reset();
 }
 
 void BaseBlockIR::to_riscv(RISCV &riscv, Controller &cont)
 {
-    if (start_with(name, "\%label_while_next"))
-    riscv.text.push_back({name.substr(1)+"_act" + ":"});
+    if (cont.get_cfg().is_loop_exit[cont.get_cfg().id(name)])
+    riscv.text.push_back({cont.block_label(symbol_name(name).substr(1) + "_act") + ":"});
     else
-    riscv.text.push_back({name.substr(1) + ":"});
+    riscv.text.push_back({cont.block_label(symbol_name(name).substr(1)) + ":"});
+    unsigned id = cont.get_cfg().id(name);
+    cont.enter_block(id);
+    // loop headers and exits are entered after a checkout of the saved registers
+    if (!cont.get_cfg().is_loop_exit[id] && !cont.get_cfg().is_loop_header(name))
+        cont.inherit(id, riscv);
     for (auto const& value : values)
+    {
         value->to_riscv(riscv, cont);
+        cont.advance();
+    }
 }
 
 void SuperBlockIR::to_riscv(RISCV &riscv, Controller &cont)
 {
-    std::unordered_map<std::string, unsigned> old_current_save;
-    std::unordered_map<std::string, unsigned> new_current_save;
-    std::vector<std::string> to_save;
-
-    for (auto const &pair : cont.current_save)
-        old_current_save.insert(pair);
+    SaveMap old_current_save = cont.current_save;
+    SaveMap new_current_save;
+    std::vector<Symbol> to_save;
 
     for (auto const &var : preserve)
     {
@@ -763,7 +1147,8 @@ void SuperBlockIR::to_riscv(RISCV &riscv, Controller &cont)
         for (int i = 1; i < SAVED_REG_NUM; i++)
         {
             int idx = saved_regs[i];
-            bool found = false;
+            // linear scan may have given the register to a value for good
+            bool found = cont.is_reserved(idx);
             for (auto const &pair : new_current_save)
                 if (pair.second == idx)
                     found = true;
@@ -786,153 +1171,362 @@ void SuperBlockIR::to_riscv(RISCV &riscv, Controller &cont)
                     new_current_save.insert(pair);
     }
 
-    auto next_name = (*base_blocks.begin())->name.substr(1);
-    if (next_name != "entry")
+    Symbol first_name = (*base_blocks.begin())->name;
+    auto next_name = symbol_name(first_name).substr(1);
+    if (first_name != sym_entry)
     {
-        riscv.text.push_back({next_name+"_prepare:"});
-        cont.set_label(next_name);
+        riscv.text.push_back({cont.block_label(next_name + "_prepare") + ":"});
+        cont.set_label(first_name);
     }
 
-    std::string from="", to="", old_name, new_name;
-    for (int i=1;i<SAVED_REG_NUM;i++)
+    if (annotation == Annotation::IR)
     {
-        for (auto& pair:old_current_save)
-            if (pair.second==saved_regs[i])
-                old_name=pair.first;
-        from+=reg_names[saved_regs[i]]+" "+old_name+" ";
-        for (auto& pair:new_current_save)
-            if (pair.second==saved_regs[i])
-                new_name=pair.first;
-        to+=reg_names[saved_regs[i]]+" "+new_name+" ";
+        std::string from="", to="", old_name, new_name;
+        for (int i=1;i<SAVED_REG_NUM;i++)
+        {
+            for (auto& pair:old_current_save)
+                if (pair.second==saved_regs[i])
+                    old_name=symbol_name(pair.first);
+            from+=reg_names[saved_regs[i]]+" "+old_name+" ";
+            for (auto& pair:new_current_save)
+                if (pair.second==saved_regs[i])
+                    new_name=symbol_name(pair.first);
+            to+=reg_names[saved_regs[i]]+" "+new_name+" ";
+        }
+        riscv.text.push_back({"#", "from", from, "to", to});
     }
-    riscv.text.push_back({"#", "from", from, "to", to});
 
-    cont.checkout(new_current_save, riscv, (*base_blocks.begin())->name != "\%entry");
+    cont.enter_block(cont.get_cfg().id(first_name));
+    cont.checkout(new_current_save, riscv, first_name != sym_entry);
+    // a global the loop only reads never needs storing back; written is
+    // only known under linear scan
+    if (reg_alloc == RegAlloc::LINEAR)
+        for (auto const &var : to_save)
+            if (cont.current_save.count(var) && cont.get_glob()->global_var.count(var) && !written.count(var))
+                cont.mark_clean(var);
     for (auto const& block : base_blocks)
         block->to_riscv(riscv, cont);
-    if ((*base_blocks.begin())->name != "\%entry")
-    riscv.text.push_back({"label_while_next_" + (*base_blocks.begin())->name.substr(18) + ":"});
+    if (exit.has_value())
+    {
+        riscv.text.push_back({cont.block_label(symbol_name(exit.value()).substr(1)) + ":"});
+        cont.enter_block(cont.get_cfg().id(exit.value()));
+    }
     cont.checkout(old_current_save, riscv);
-    if ((*base_blocks.begin())->name != "\%entry")
-    riscv.text.push_back({"j","label_while_next_" + (*base_blocks.begin())->name.substr(18) + "_act"});
+    if (exit.has_value())
+    riscv.text.push_back({"j", cont.block_label(symbol_name(exit.value()).substr(1) + "_act")});
 }
 
 void ProgramIR::gather_super()
 {
-    for (auto& func : functions)
-        func->gather_super();
+    parallel_for(functions.size(), [&](size_t i, unsigned)
+    {
+        if (!functions[i]->cached.has_value())
+            functions[i]->gather_super();
+    });
 }
 
-std::unique_ptr<SuperBlockIR> get_super(std::unordered_map<std::string, std::unique_ptr<BaseBlockIR>>& map, std::string start, bool first=false)
+void CFG::build(const List<arena_ptr<BaseBlockIR>> &base_blocks, const std::vector<std::pair<Symbol, Symbol>> &loops)
 {
-    std::unordered_set<std::string> permit_next;
-    auto super = std::make_unique<SuperBlockIR>();
-    std::queue<std::string> q;
-    q.push(start);
-    while(!q.empty())
+    clear();
+    ids.reserve(base_blocks.size());
+    for (auto const &block : base_blocks)
+    {
+        ids[block->name] = blocks.size();
+        blocks.push_back(block.get());
+    }
+    unsigned n = blocks.size();
+    succs.resize(n);
+    preds.resize(n);
+    loop_exit.assign(n, NONE);
+    is_loop_exit.assign(n, false);
+    for (unsigned i = 0; i < n; i++)
     {
-        std::string cur = q.front();
-        q.pop();
+        auto const &last = *blocks[i]->values.rbegin();
+        int first = 0, end = 0;
+        if (last->op == IROP::JUMP)
+            end = 1;
+        else if (last->op == IROP::BR)
+            first = 1, end = 3;
+        for (int k = first; k < end; k++)
+        {
+            unsigned j = id(last->args[k]);
+            if (std::find(succs[i].begin(), succs[i].end(), j) != succs[i].end())
+                continue;
+            succs[i].push_back(j);
+            preds[j].push_back(i);
+        }
+    }
+    for (auto const &loop : loops)
+    {
+        loop_exit[id(loop.first)] = id(loop.second);
+        is_loop_exit[id(loop.second)] = true;
+    }
 
-        if (cur.length() >= 17 && cur.substr(7, 10) == "while_next" && !permit_next.count(cur))
+    // iterative depth-first search from the entry
+    std::vector<bool> seen(n, false);
+    std::vector<std::pair<unsigned, unsigned>> stack;
+    if (n)
+        stack.push_back({0, 0}), seen[0] = true;
+    while (!stack.empty())
+    {
+        auto &top = stack.back();
+        if (top.second < succs[top.first].size())
+        {
+            unsigned next = succs[top.first][top.second++];
+            if (!seen[next])
+                seen[next] = true, stack.push_back({next, 0});
             continue;
-        else if (start_with(cur, "\%label_exit") && !first)
+        }
+        rpo.push_back(top.first);
+        stack.pop_back();
+    }
+    std::reverse(rpo.begin(), rpo.end());
+}
+
+// The blocks keep their order and the edges theirs, so the result is what
+// build gives once the blocks are gone.
+void CFG::retain(const std::vector<bool> &keep)
+{
+    unsigned n = blocks.size(), m = 0;
+    std::vector<unsigned> index(n, NONE);
+    std::vector<bool> reachable(n, false);
+    for (auto b : rpo)
+        reachable[b] = true;
+    for (unsigned i = 0; i < n; i++)
+        if (keep[i])
+            index[i] = m++;
+    for (unsigned i = 0; i < n; i++)
+    {
+        if (!keep[i])
+        {
+            ids.erase(blocks[i]->name);
             continue;
-        else if (cur.length() >= 17 && cur.substr(7, 10) == "while_cond" && cur != start)
+        }
+        unsigned j = index[i];
+        ids[blocks[i]->name] = j;
+        blocks[j] = blocks[i];
+        if (!reachable[i])
+            succs[i].clear();
+        for (auto &succ : succs[i])
+            succ = index[succ];
+        auto &pred = preds[i];
+        pred.erase(std::remove_if(pred.begin(), pred.end(), [&](unsigned p) { return !reachable[p]; }), pred.end());
+        for (auto &p : pred)
+            p = index[p];
+        if (j != i)
+            succs[j] = std::move(succs[i]), preds[j] = std::move(preds[i]);
+        loop_exit[j] = reachable[i] && loop_exit[i] != NONE ? index[loop_exit[i]] : NONE;
+    }
+    blocks.resize(m);
+    succs.resize(m);
+    preds.resize(m);
+    loop_exit.resize(m);
+    is_loop_exit.assign(m, false);
+    for (auto exit : loop_exit)
+        if (exit != NONE)
+            is_loop_exit[exit] = true;
+    for (auto &b : rpo)
+        b = index[b];
+}
+
+// Cooper, Harvey and Kennedy's iteration over the reverse post-order
+void CFG::build_dominators()
+{
+    unsigned n = blocks.size();
+    std::vector<unsigned> order(n, NONE);
+    for (unsigned i = 0; i < rpo.size(); i++)
+        order[rpo[i]] = i;
+    idom.assign(n, NONE);
+    dom_children.assign(n, {});
+    frontier.assign(n, {});
+    if (!n)
+        return;
+    idom[0] = 0;
+    auto intersect = [&](unsigned a, unsigned b)
+    {
+        while (a != b)
         {
-            super->base_blocks.push_back(get_super(map, cur));
-            std::string next_name = "\%label_while_next_" + cur.substr(18);
-            q.push(next_name);
-            permit_next.insert(next_name);
+            while (order[a] > order[b])
+                a = idom[a];
+            while (order[b] > order[a])
+                b = idom[b];
         }
-        else
+        return a;
+    };
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (unsigned i = 1; i < rpo.size(); i++)
         {
-            if (map.find(cur) == map.end())
-                continue;
-            auto block = std::move(map[cur]);
-            map.erase(cur);
-            auto last_v = block->values.rbegin();
-            if ((*last_v)->op == "jump")
+            unsigned b = rpo[i], new_idom = NONE;
+            for (auto p : preds[b])
+                if (idom[p] != NONE)
+                    new_idom = new_idom == NONE ? p : intersect(p, new_idom);
+            if (idom[b] != new_idom)
+                idom[b] = new_idom, changed = true;
+        }
+    }
+    for (unsigned i = 1; i < rpo.size(); i++)
+        dom_children[idom[rpo[i]]].push_back(rpo[i]);
+    for (auto b : rpo)
+    {
+        if (preds[b].size() < 2)
+            continue;
+        for (auto p : preds[b])
+            for (unsigned runner = p; idom[p] != NONE && runner != idom[b]; runner = idom[runner])
             {
-                if ((*last_v)->args[0] != start)
-                    q.push((*last_v)->args[0]);
+                if (!frontier[runner].empty() && frontier[runner].back() == b)
+                    break;
+                frontier[runner].push_back(b);
             }
-            else if ((*last_v)->op == "br")
-                q.push((*last_v)->args[1]), q.push((*last_v)->args[2]);
+    }
+}
+
+void CFG::clear()
+{
+    blocks.clear();
+    succs.clear();
+    preds.clear();
+    rpo.clear();
+    loop_exit.clear();
+    is_loop_exit.clear();
+    ids.clear();
+    idom.clear();
+    dom_children.clear();
+    frontier.clear();
+    live_out.clear();
+    reads.clear();
+}
 
-            super->base_blocks.push_back(std::move(block));
+// The region of the loop headed by start, or of the whole function, in
+// depth-first order, so a block is followed by a successor where one is left:
+// the branch to it falls through. The true target of a br goes first. A
+// nested loop becomes a super block of its own, and its exit block belongs to
+// the region around it, which is the only one that enters it; it is placed
+// right after the loop.
+static arena_ptr<SuperBlockIR> get_super(Arena &pool, const CFG &cfg, std::vector<arena_ptr<BaseBlockIR>> &blocks, std::vector<bool> &entered, unsigned start)
+{
+    auto super = make_arena<SuperBlockIR>(pool);
+    if (cfg.loop_exit[start] != CFG::NONE)
+        super->exit = cfg.blocks[cfg.loop_exit[start]]->name;
+    std::vector<unsigned> stack = {start};
+    while (!stack.empty())
+    {
+        unsigned cur = stack.back();
+        stack.pop_back();
+        if (!blocks[cur] || (cfg.is_loop_exit[cur] && !entered[cur]))
+            continue;
+        if (cfg.loop_exit[cur] != CFG::NONE && cur != start)
+        {
+            super->base_blocks.push_back(get_super(pool, cfg, blocks, entered, cur));
+            entered[cfg.loop_exit[cur]] = true;
+            stack.push_back(cfg.loop_exit[cur]);
+            continue;
         }
+        for (auto next = cfg.succs[cur].rbegin(); next != cfg.succs[cur].rend(); next++)
+            if (*next != start)
+                stack.push_back(*next);
+        super->base_blocks.push_back(std::move(blocks[cur]));
     }
     return super;
 }
 
 void FunctionIR::gather_super()
 {
-    std::unordered_map<std::string, std::unique_ptr<BaseBlockIR>> map;
+    PhaseTimer timer("gather_super", &name);
+    std::vector<arena_ptr<BaseBlockIR>> blocks;
     for (auto& block : base_blocks)
-        map[block->name] = std::move(block);
-    super_block = get_super(map, "\%entry", true);
+        blocks.push_back(std::move(block));
+    std::vector<bool> entered(blocks.size(), false);
+    super_block = get_super(*pool, cfg, blocks, entered, 0);
 }
 
 void ProgramIR::alloc_preserve(bool in_while)
 {
-    for (auto& func : functions)
-        func->alloc_preserve();
+    std::unordered_set<Symbol> globals;
+    if (reg_alloc == RegAlloc::LINEAR)
+        for (auto const &value : values)
+            if (value->op == IROP::GLOBAL_ALLOC && value->args[1] == sym_i32)
+                globals.insert(value->args[0]);
+    parallel_for(functions.size(), [&](size_t i, unsigned)
+    {
+        if (functions[i]->cached.has_value())
+            return;
+        functions[i]->alloc_preserve();
+        if (reg_alloc == RegAlloc::LINEAR)
+            functions[i]->preserve_globals(globals);
+    });
 }
 
 void FunctionIR::alloc_preserve(bool in_while)
 {
-    super_block->alloc_preserve(false);
+    PhaseTimer timer("alloc_preserve", &name);
+    if (reg_alloc == RegAlloc::LINEAR)
+        allocate_registers();
+    else
+        super_block->alloc_preserve(false);
 }
 
-void add_count(std::unordered_map<std::string, unsigned>& count, std::string key, unsigned value=1)
+void add_count(std::unordered_map<Symbol, unsigned>& count, Symbol key, unsigned value=1)
 {
-    if (count.find(key) == count.end())
-        count[key] = 0;
     count[key] += value;
 }
 
-void check_and_add_count(std::unordered_map<std::string, unsigned>& count, std::string key, unsigned value=1)
+void check_and_add_count(std::unordered_map<Symbol, unsigned>& count, Symbol key, unsigned value=1)
 {
-    if (is_allocvar(key))
+    if (symbol_info(key).is_allocvar)
         add_count(count, key, value);
 }
 
 void BaseBlockIR::alloc_preserve(bool in_while)
 {
+    for (auto param : params)
+        check_and_add_count(count, param);
     for (const auto& value : values)
     {
-        if (!value->args.empty() && value->args[value->args.size() - 1] == "disgard")
+        if (!value->args.empty() && value->args[value->args.size() - 1] == sym_disgard)
             continue;
-        else if (value->op == "//!")
-            continue;
-        else if (value->op == "ret" && value->args.size())
-            check_and_add_count(count, value->args[0]);
-        else if (value->op == "br")
-            check_and_add_count(count, value->args[0]);
-        else if (value->op == "load")
-        {
-            check_and_add_count(count, value->args[0]);
-            check_and_add_count(count, value->args[1]);
-        }
-        else if (value->op == "store" && value->args[0][0] != '{')
+        if (value->edge_args)
+            for (auto const& edge : value->edge_args->args)
+                for (auto arg : edge)
+                    check_and_add_count(count, arg);
+        switch (value->op)
         {
+        case IROP::RET:
+            if (value->args.size())
+                check_and_add_count(count, value->args[0]);
+            break;
+        case IROP::BR:
             check_and_add_count(count, value->args[0]);
-            check_and_add_count(count, value->args[1]);
-        }
-        else if (op_name.count(value->op))
-        {
+            break;
+        case IROP::LOAD:
             check_and_add_count(count, value->args[0]);
             check_and_add_count(count, value->args[1]);
-            check_and_add_count(count, value->args[2]);
-        }
-        else if (start_with(value->op, "call"))
-        {
+            break;
+        case IROP::STORE:
+            if (value->args[0] != init_sym)
+            {
+                check_and_add_count(count, value->args[0]);
+                check_and_add_count(count, value->args[1]);
+            }
+            break;
+        case IROP::CALL_INT:
+        case IROP::CALL_VOID:
             for (int i = 1; i < value->args.size(); i++)
                 check_and_add_count(count, value->args[i]);
-        }
-        else if (value->op == "getptr" || value->op == "getelemptr")
+            break;
+        case IROP::GETPTR:
+        case IROP::GETELEMPTR:
             check_and_add_count(count, value->args[2]);
+            break;
+        default:
+            if (get_irop_info(value->op).binary)
+            {
+                check_and_add_count(count, value->args[0]);
+                check_and_add_count(count, value->args[1]);
+                check_and_add_count(count, value->args[2]);
+            }
+        }
     }
 }
 
@@ -945,15 +1539,18 @@ void SuperBlockIR::alloc_preserve(bool in_while)
             add_count(count, pair.first);
     }
 
-    std::vector<std::pair<std::string, unsigned>> vec;
+    // ties go by name: neither hash order nor interning order is stable once
+    // functions are lowered in parallel
+    std::vector<std::pair<Symbol, unsigned>> vec;
     for (auto& pair : count)
         vec.push_back({pair.first, pair.second});
-    std::sort(vec.begin(), vec.end(), [](const std::pair<std::string, unsigned>& a, const std::pair<std::string, unsigned>& b) { return a.second > b.second; });
-    for (int i = 0; i < std::min(SAVED_REG_NUM-1, (int)vec.size()); i++)
+    int keep = std::min(SAVED_REG_NUM-1, (int)vec.size());
+    std::partial_sort(vec.begin(), vec.begin() + keep, vec.end(), [](const std::pair<Symbol, unsigned>& a, const std::pair<Symbol, unsigned>& b) { return a.second != b.second ? a.second > b.second : symbol_name(a.first) < symbol_name(b.first); });
+    for (int i = 0; i < keep; i++)
     {
         // std::cout<<vec[i].first<<" "<<vec[i].second<<std::endl;
         if (vec[i].second > (in_while ? 0 : 1))
-            preserve.insert(vec[i].first);
+            preserve.push_back(vec[i].first);
     }
     
     // for (auto s : preserve)
@@ -961,6 +1558,55 @@ void SuperBlockIR::alloc_preserve(bool in_while)
     // std::cout<<std::endl;
 }
 
+// Linear scan leaves globals to the Controller, which would load them again
+// after every call, as the registers it caches them in are caller-saved. In
+// a saved register, a global is stored before a call and loaded after it
+// only if the callee may use or assign it (Controller::transition).
+void FunctionIR::preserve_globals(const std::unordered_set<Symbol> &globals)
+{
+    if (globals.empty())
+        return;
+    unsigned left = SAVED_REG_NUM - 1;
+    for (int i = 1; i < SAVED_REG_NUM; i++)
+        for (auto const &pin : pinned)
+            if (pin.second == saved_regs[i])
+            {
+                left--;
+                break;
+            }
+    super_block->preserve_globals(globals, left);
+}
+
+void SuperBlockIR::preserve_globals(const std::unordered_set<Symbol> &globals, unsigned limit)
+{
+    for (auto &block : base_blocks)
+    {
+        if (auto super = dynamic_cast<SuperBlockIR *>(block.get()))
+        {
+            super->preserve_globals(globals, limit);
+            for (auto &pair : super->count)
+                add_count(count, pair.first, pair.second);
+            written.insert(super->written.begin(), super->written.end());
+            continue;
+        }
+        for (auto const &value : static_cast<BaseBlockIR *>(block.get())->values)
+            if ((value->op == IROP::LOAD || (value->op == IROP::STORE && value->args[0] != init_sym)) && globals.count(value->args[1]))
+            {
+                add_count(count, value->args[1]);
+                if (value->op == IROP::STORE)
+                    written.insert(value->args[1]);
+            }
+    }
+    // the function body runs once, the globals it uses are loaded where used
+    if (!exit.has_value())
+        return;
+    std::vector<std::pair<Symbol, unsigned>> vec(count.begin(), count.end());
+    unsigned keep = std::min<size_t>(limit, vec.size());
+    std::partial_sort(vec.begin(), vec.begin() + keep, vec.end(), [](const std::pair<Symbol, unsigned>& a, const std::pair<Symbol, unsigned>& b) { return a.second != b.second ? a.second > b.second : symbol_name(a.first) < symbol_name(b.first); });
+    for (unsigned i = 0; i < keep; i++)
+        preserve.push_back(vec[i].first);
+}
+
 void ProgramIR::print_super()
 {
     for (auto& func : functions)
@@ -979,10 +1625,10 @@ void SuperBlockIR::print_super()
 {
     std::cout<<"super:"<<std::endl;
     for (auto& block : base_blocks)
-        std::cout<<"\t"<<block->name<<std::endl;
+        std::cout<<"\t"<<symbol_name(block->name)<<std::endl;
     std::cout<<std::endl;
     for (auto& pre : preserve)
-        std::cout<<"\t"<<pre<<std::endl;
+        std::cout<<"\t"<<symbol_name(pre)<<std::endl;
     std::cout<<std::endl;
     for (auto& block : base_blocks)
         block->print_super();
@@ -0,0 +1,28 @@
+#include <log.h>
+#include <iostream>
+
+LogLevel log_level = LogLevel::ERROR;
+
+static std::ostream null_stream(nullptr);
+
+bool set_log_level(const std::string name)
+{
+    if (name == "silent")
+        log_level = LogLevel::SILENT;
+    else if (name == "error")
+        log_level = LogLevel::ERROR;
+    else if (name == "warn")
+        log_level = LogLevel::WARN;
+    else if (name == "info")
+        log_level = LogLevel::INFO;
+    else if (name == "debug")
+        log_level = LogLevel::DEBUG;
+    else
+        return false;
+    return true;
+}
+
+std::ostream &logger(LogLevel level)
+{
+    return log_enabled(level) ? std::cerr : null_stream;
+}
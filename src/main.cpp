@@ -1,80 +1,343 @@
 #include <cassert>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
 #include <fstream>
 #include <memory>
+#include <optional>
+#include <algorithm>
 #include <random>
 #include <string>
+#include <thread>
+#include <vector>
 #include <string.h>
 #include <ast.h>
 #include <riscv.h>
+#include <log.h>
+#include <source.h>
+#include <timer.h>
+#include <cache.h>
+#include <batch.h>
 
-extern FILE *yyin;
-extern int yyparse(std::unique_ptr<BaseAST> &ast);
+typedef struct yy_buffer_state *YY_BUFFER_STATE;
+extern YY_BUFFER_STATE yy_scan_buffer(char *base, size_t size);
+extern int yylex_destroy();
+extern int yyparse(arena_ptr<BaseAST> &ast);
 
-int main(int argc, const char *argv[]) {
-  srand(1);
+struct Options
+{
+  const char *mode = nullptr;
+  const char *input = nullptr;
+  const char *output = nullptr;
+  bool dump_ast = false;
+  bool dump_ir = false;
+  bool dump_super = false;
+  bool dump_asm = false;
+  const char *time_report = nullptr;
+  const char *time_report_file = nullptr;
+  const char *cache_dir = nullptr;
+  uint64_t cache_size = 256;
+  bool cache_stats = false;
+  bool spill_stats = false;
+  const char *batch = nullptr;
+  const char *serve = nullptr;
+  unsigned workers = 0;
+};
 
-  assert(argc == 5);
-  auto mode = argv[1];
-  auto input = argv[2];
-  auto output = argv[4];
+static void usage(const char *prog)
+{
+  std::cerr << "usage: " << prog << " -koopa|-riscv|-perf <input> -o <output> [options]" << std::endl
+            << "       " << prog << " --batch=<manifest>|--serve=<socket> [--workers=<n>] [-v]" << std::endl
+            << "  -v, --verbose          raise the log level by one, may be repeated" << std::endl
+            << "  --log-level=<level>    silent, error, warn, info or debug" << std::endl
+            << "  -j <n>                 generate code for functions on n threads" << std::endl
+            << "  --dump-ast             print the AST to stdout" << std::endl
+            << "  --dump-ir              print the Koopa IR to stdout" << std::endl
+            << "  --dump-super           print the super blocks to stdout" << std::endl
+            << "  --dump-asm             print the RISC-V assembly to stdout" << std::endl
+            << "  --no-mem2reg           keep scalar locals in memory instead of SSA values" << std::endl
+            << "  --regalloc=<kind>      linear (registers per function, default) or lru (cached per block)" << std::endl
+            << "  --spill-stats          print the stack slot loads and stores generated to stderr" << std::endl
+            << "                         and lead each in the assembly with a # spill line" << std::endl
+            << "  --annotate=<what>      none, ir (IR as comments) or source (.loc lines), default none" << std::endl
+            << "  --time-report[=json]   print time and peak memory per phase and function" << std::endl
+            << "  --time-report-file=<f> write the time report to f instead of stderr" << std::endl
+            << "  --cache-dir=<dir>      reuse the output of unchanged functions from dir" << std::endl
+            << "  --cache-size=<MB>      evict least recently used entries beyond this, default 256" << std::endl
+            << "  --cache-stats          print function cache hits and misses to stderr" << std::endl
+            << "  --batch=<manifest>     run each line of manifest as the arguments of one compile" << std::endl
+            << "  --serve=<socket>       take one line of arguments per connection on a Unix socket," << std::endl
+            << "                         led by --cwd=<dir> to resolve relative paths against dir" << std::endl
+            << "  --workers=<n>          compiles run at once in batch and server mode" << std::endl;
+}
 
-  assert(!strcmp(mode, "-koopa") || !strcmp(mode, "-riscv") || !strcmp(mode, "-perf"));
+static bool parse_options(int argc, const char *argv[], Options &opts)
+{
+  for (int i = 1; i < argc; i++)
+  {
+    std::string arg = argv[i];
+    if (arg == "-koopa" || arg == "-riscv" || arg == "-perf")
+      opts.mode = argv[i];
+    else if (arg == "-o" && i + 1 < argc)
+      opts.output = argv[++i];
+    else if (arg == "-v" || arg == "--verbose")
+      log_level = (log_level < LogLevel::DEBUG) ? LogLevel(int(log_level) + 1) : LogLevel::DEBUG;
+    else if (arg.rfind("--log-level=", 0) == 0)
+    {
+      if (!set_log_level(arg.substr(strlen("--log-level="))))
+        return false;
+    }
+    else if (arg == "-j" && i + 1 < argc)
+    {
+      int jobs = atoi(argv[++i]);
+      if (jobs < 1)
+        return false;
+      codegen_jobs = jobs;
+    }
+    else if (arg == "--dump-ast")
+      opts.dump_ast = true;
+    else if (arg == "--dump-ir")
+      opts.dump_ir = true;
+    else if (arg == "--dump-super")
+      opts.dump_super = true;
+    else if (arg == "--dump-asm")
+      opts.dump_asm = true;
+    else if (arg == "--no-mem2reg")
+      mem2reg_enabled = false;
+    else if (arg == "--regalloc=linear")
+      reg_alloc = RegAlloc::LINEAR;
+    else if (arg == "--regalloc=lru")
+      reg_alloc = RegAlloc::LRU;
+    else if (arg == "--spill-stats")
+      opts.spill_stats = true;
+    else if (arg == "--annotate=none")
+      annotation = Annotation::NONE;
+    else if (arg == "--annotate=ir")
+      annotation = Annotation::IR;
+    else if (arg == "--annotate=source")
+      annotation = Annotation::SOURCE;
+    else if (arg == "--time-report" || arg == "--time-report=text")
+      opts.time_report = "text";
+    else if (arg == "--time-report=json")
+      opts.time_report = "json";
+    else if (arg.rfind("--time-report-file=", 0) == 0)
+      opts.time_report_file = argv[i] + strlen("--time-report-file=");
+    else if (arg.rfind("--cache-dir=", 0) == 0)
+      opts.cache_dir = argv[i] + strlen("--cache-dir=");
+    else if (arg.rfind("--cache-size=", 0) == 0)
+    {
+      // a typo must not become a size of 0, which would empty the cache
+      const char *text = argv[i] + strlen("--cache-size=");
+      char *end;
+      errno = 0;
+      unsigned long long size = strtoull(text, &end, 10);
+      if (!isdigit((unsigned char)*text) || *end || errno == ERANGE || size > (UINT64_MAX >> 20))
+        return false;
+      opts.cache_size = size;
+    }
+    else if (arg == "--cache-stats")
+      opts.cache_stats = true;
+    else if (arg.rfind("--batch=", 0) == 0)
+      opts.batch = argv[i] + strlen("--batch=");
+    else if (arg.rfind("--serve=", 0) == 0)
+      opts.serve = argv[i] + strlen("--serve=");
+    else if (arg.rfind("--workers=", 0) == 0)
+    {
+      int workers = atoi(argv[i] + strlen("--workers="));
+      if (workers < 1)
+        return false;
+      opts.workers = workers;
+    }
+    else if (arg[0] != '-' && !opts.input)
+      opts.input = argv[i];
+    else
+      return false;
+  }
+  if (opts.batch || opts.serve)
+    return !opts.mode && !opts.input && !opts.output && !(opts.batch && opts.serve);
+  return opts.mode && opts.input && opts.output;
+}
+
+static int compile(Options &opts)
+{
+  srand(1);
 
-  std::ifstream input_file(input);
-  char temp_char;
-  std::cout << "Input file:" << std::endl << std::endl;
-  while (true)
+  bool to_riscv = strcmp(opts.mode, "-koopa");
+  if (opts.time_report_file && !opts.time_report)
+    opts.time_report = "text";
+  std::unique_ptr<TimeReport> report;
+  if (opts.time_report)
+    report = std::make_unique<TimeReport>(), time_report = report.get();
+  // cached functions have no IR left to dump
+  if (opts.cache_dir && to_riscv && (opts.dump_ir || opts.dump_super))
   {
-    input_file.get(temp_char);
-    if (input_file.eof())
-      break;
-    std::cout << temp_char;
+    logger(LogLevel::INFO) << "--dump-ir and --dump-super turn the function cache off" << std::endl;
+    opts.cache_dir = nullptr;
+  }
+  annotation_file = opts.input;
+  mark_spills = opts.spill_stats;
+  std::unique_ptr<FunctionCache> cache;
+  if (opts.cache_dir)
+  {
+    // the annotation and spill marks are part of the generated text
+    std::string mode = opts.mode;
+    if (!mem2reg_enabled)
+      mode += " no-mem2reg";
+    if (reg_alloc == RegAlloc::LRU)
+      mode += " regalloc=lru";
+    if (to_riscv)
+      mode += " annotate=" + std::to_string(int(annotation));
+    if (to_riscv && mark_spills)
+      mode += " spill-marks";
+    cache = std::make_unique<FunctionCache>(opts.cache_dir, mode, (uint64_t)opts.cache_size << 20,
+                                            to_riscv && annotation == Annotation::SOURCE);
+    if (cache->is_open())
+      function_cache = cache.get();
   }
-  std::cout << std::endl << "end of input" << std::endl << std::endl;
 
-  yyin = fopen(input, "r");
-  assert(yyin);
+  SourceBuffer source;
+  std::optional<PhaseTimer> timer;
+  timer.emplace("read");
+  if (!source.open(opts.input))
+  {
+    logger(LogLevel::ERROR) << "cannot open " << opts.input << std::endl;
+    return 1;
+  }
+  if (log_enabled(LogLevel::DEBUG))
+  {
+    logger(LogLevel::DEBUG) << "Input file:" << std::endl << std::endl;
+    logger(LogLevel::DEBUG).write(source.get_text(), source.get_size());
+    logger(LogLevel::DEBUG) << std::endl << "end of input" << std::endl << std::endl;
+  }
 
-  std::unique_ptr<BaseAST> ast;
+  timer.emplace("parse");
+  yy_scan_buffer(source.get_lex_base(), source.get_lex_size());
+  arena_ptr<BaseAST> ast;
   auto ret = yyparse(ast);
+  yylex_destroy();
+  source.close();
+  timer.reset();
   if (ret)
   {
-    std::cout << "Error parse" << std::endl << std::endl;
+    logger(LogLevel::ERROR) << "Error parse" << std::endl << std::endl;
     return -114514;
   }
-  
-  std::cout << "Success parse" << std::endl << std::endl;
-  // std::string ast_str;
-  // ast->to_string(ast_str);
-  // std::cout << "AST:" << std::endl << std::endl;
-  // std::cout << ast_str << std::endl;
+
+  logger(LogLevel::INFO) << "Success parse" << std::endl << std::endl;
+  if (opts.dump_ast)
+  {
+    std::string ast_str;
+    ast->to_string(ast_str);
+    std::cout << "AST:" << std::endl << std::endl;
+    std::cout << ast_str << std::endl;
+  }
 
   std::unique_ptr<BaseIR> ir;
   std::shared_ptr<IRINFO> temp_info;
+  timer.emplace("ir");
   ir = ast->to_ir(temp_info);
+  ast.reset();
+  ast_arena.reset();
+  timer.reset();
+  logger(LogLevel::INFO) << "Generated IR" << std::endl;
 
-  std::string result;
-  ir->to_string(result);
-  std::cout << "IR:" << std::endl << std::endl;
-  std::cout << result << std::endl;
+  std::ofstream output_file(opts.output);
+  if (!to_riscv || opts.dump_ir)
+  {
+    std::string result;
+    timer.emplace("ir.text");
+    ir->to_string(result);
+    timer.reset();
+    if (opts.dump_ir)
+    {
+      std::cout << "IR:" << std::endl << std::endl;
+      std::cout << result << std::endl;
+    }
+    if (!to_riscv)
+    {
+      PhaseTimer write_timer("write");
+      output_file << result;
+      output_file.close();
+    }
+  }
 
-  if (!strcmp(mode, "-riscv") || !strcmp(mode, "-perf"))
+  if (to_riscv)
   {
+    timer.emplace("gather_super");
     ir->gather_super();
+    timer.emplace("alloc_preserve");
     ir->alloc_preserve();
-    ir->print_super();
-    result.clear();
-    RISCV riscv;
+    timer.reset();
+    if (opts.dump_super)
+      ir->print_super();
+    RISCV riscv(output_file);
+    if (opts.dump_asm)
+      riscv.set_echo(std::cout);
     Controller cont;
+    timer.emplace("riscv");
     ir->to_riscv(riscv, cont);
-    riscv.to_string(result);
-    // std::cout << result << std::endl;
+    timer.emplace("write");
+    riscv.flush();
+    // functions taken from the cache are not counted
+    if (opts.spill_stats)
+      std::cerr << "spill code: " << cont.spill_loads << " loads, " << cont.spill_stores << " stores" << std::endl;
+    output_file.close();
+    timer.reset();
+    logger(LogLevel::INFO) << "Generated RISC-V" << std::endl;
+  }
+
+  if (function_cache)
+  {
+    function_cache->evict();
+    if (opts.cache_stats)
+      function_cache->print_stats(std::cerr);
+    function_cache = nullptr;
   }
 
-  std::ofstream output_file(output);
-  output_file << result;
+  if (report)
+  {
+    std::ofstream report_file;
+    if (opts.time_report_file)
+      report_file.open(opts.time_report_file);
+    std::ostream &out = opts.time_report_file ? report_file : std::cerr;
+    if (!strcmp(opts.time_report, "json"))
+      report->print_json(out);
+    else
+      report->print_text(out);
+    time_report = nullptr;
+  }
 
   return 0;
 }
+
+static int run_job(const std::vector<std::string> &args)
+{
+  std::vector<const char *> argv = {"compiler"};
+  for (auto const &arg : args)
+    argv.push_back(arg.c_str());
+  Options opts;
+  if (!parse_options(argv.size(), argv.data(), opts) || opts.batch || opts.serve)
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  return compile(opts);
+}
+
+int main(int argc, const char *argv[]) {
+  Options opts;
+  if (!parse_options(argc, argv, opts))
+  {
+    usage(argv[0]);
+    return 1;
+  }
+  unsigned workers = opts.workers ? opts.workers : std::max(1u, std::thread::hardware_concurrency());
+  if (opts.batch)
+    return run_batch(opts.batch, workers, run_job);
+  if (opts.serve)
+    return run_server(opts.serve, workers, run_job);
+  return compile(opts);
+}
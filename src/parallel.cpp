@@ -0,0 +1,33 @@
+#include <parallel.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+unsigned codegen_jobs = 1;
+
+unsigned parallel_workers(size_t n)
+{
+    return std::max<size_t>(1, std::min<size_t>(codegen_jobs, n));
+}
+
+void parallel_for(size_t n, const std::function<void(size_t, unsigned)> &task)
+{
+    unsigned workers = parallel_workers(n);
+    if (workers == 1)
+    {
+        for (size_t i = 0; i < n; i++)
+            task(i, 0);
+        return;
+    }
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    for (unsigned w = 0; w < workers; w++)
+        threads.emplace_back([&, w]()
+        {
+            for (size_t i; (i = next++) < n;)
+                task(i, w);
+        });
+    for (auto &thread : threads)
+        thread.join();
+}
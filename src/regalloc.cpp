@@ -0,0 +1,549 @@
+#include <ir.h>
+#include <timer.h>
+#include <algorithm>
+#include <cstdint>
+
+RegAlloc reg_alloc = RegAlloc::LINEAR;
+
+static const Symbol sym_zero = intern("0");
+static const Symbol sym_i32 = intern("i32");
+static const Symbol sym_decl = intern("decl");
+static const Symbol sym_disgard = intern("disgard");
+
+// The registers handed out, caller-saved first: those cost nothing while no
+// call intervenes. a0-a7 stay with the Controller, for call arguments and for
+// the values left in memory.
+static const int alloc_regs[] = {
+    5, 6, 7, 28, 29,                            // t0-4
+    9, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27,  // s1-11
+};
+static const unsigned ALLOC_REG_NUM = sizeof(alloc_regs) / sizeof(alloc_regs[0]);
+static const unsigned CALLER_SAVED_NUM = 5;
+
+namespace
+{
+struct Range
+{
+    unsigned from, to;
+};
+
+// one read or write of a value at a position; an instruction k reads at 2k
+// and writes at 2k+1
+struct Access
+{
+    unsigned pos, var;
+    bool def;
+};
+
+// tables of one function, kept per thread so their storage is reused
+struct Tables
+{
+    SymbolMap<unsigned> var_id;
+    SymbolMap<bool> ptr;
+    void clear() { var_id.clear(), ptr.clear(); }
+};
+thread_local Tables tables;
+}
+
+// Calls use(name) for every value the instruction reads and def(name) for the
+// one it writes, as the backend lowers it: a store through a pointer reads
+// the pointer, any other store writes the variable.
+template <typename Use, typename Def>
+static void scan(const ValueIR &value, const SymbolMap<bool> &ptr, Use use, Def def)
+{
+    auto const &args = value.args;
+    switch (value.op)
+    {
+    case IROP::RET:
+        if (args.size())
+            use(args[0]);
+        break;
+    case IROP::BR:
+        use(args[0]);
+        break;
+    case IROP::CALL_INT:
+        for (unsigned i = 2; i < args.size(); i++)
+            use(args[i]);
+        def(args[1]);
+        break;
+    case IROP::CALL_VOID:
+        for (unsigned i = 1; i < args.size(); i++)
+            use(args[i]);
+        break;
+    case IROP::LOAD:
+        use(args[1]);
+        def(args[0]);
+        break;
+    case IROP::STORE:
+        if (args[0] == init_sym)
+            break;
+        use(args[0]);
+        if (ptr.count(args[1]))
+            use(args[1]);
+        else
+            def(args[1]);
+        break;
+    case IROP::GETPTR:
+        use(args[1]);
+        use(args[2]);
+        def(args[0]);
+        break;
+    case IROP::GETELEMPTR:
+        use(args[2]);
+        def(args[0]);
+        break;
+    default:
+        if (get_irop_info(value.op).binary)
+        {
+            use(args[1]);
+            use(args[2]);
+            def(args[0]);
+        }
+    }
+}
+
+// The reachable blocks in reverse post-order, then the ones the entry does
+// not reach.
+static std::vector<unsigned> block_order(const CFG &cfg)
+{
+    unsigned n = cfg.blocks.size();
+    std::vector<unsigned> order(cfg.rpo.begin(), cfg.rpo.end());
+    if (order.size() < n)
+    {
+        std::vector<bool> placed(n, false);
+        for (auto b : order)
+            placed[b] = true;
+        for (unsigned b = 0; b < n; b++)
+            if (!placed[b])
+                order.push_back(b);
+    }
+    return order;
+}
+
+// Block liveness over bit sets of the given number of words per block, from
+// what each block reads before writing (gen) and what it writes (kill).
+static void solve_liveness(const CFG &cfg, const std::vector<unsigned> &order, unsigned words, const std::vector<uint64_t> &gen, const std::vector<uint64_t> &kill, std::vector<uint64_t> &live_in, std::vector<uint64_t> &live_out)
+{
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (auto it = order.rbegin(); it != order.rend(); it++)
+            for (unsigned w = 0; w < words; w++)
+            {
+                uint64_t out = 0;
+                for (auto succ : cfg.succs[*it])
+                    out |= live_in[succ * words + w];
+                live_out[*it * words + w] = out;
+                uint64_t in = gen[*it * words + w] | (out & ~kill[*it * words + w]);
+                if (in != live_in[*it * words + w])
+                    live_in[*it * words + w] = in, changed = true;
+            }
+    }
+}
+
+static void loop_depth(const BlockIR &block, const CFG &cfg, unsigned depth, std::vector<unsigned> &result)
+{
+    if (auto super = dynamic_cast<const SuperBlockIR *>(&block))
+    {
+        for (auto const &sub : super->base_blocks)
+            loop_depth(*sub, cfg, depth + super->exit.has_value(), result);
+    }
+    else
+        result[cfg.id(block.name)] = depth;
+}
+
+static bool intersects(const std::vector<Range> &a, const std::vector<Range> &b)
+{
+    if (a.back().to < b.front().from || b.back().to < a.front().from)
+        return false;
+    for (size_t i = 0, j = 0; i < a.size() && j < b.size();)
+    {
+        if (a[i].to < b[j].from)
+            i++;
+        else if (b[j].to < a[i].from)
+            j++;
+        else
+            return true;
+    }
+    return false;
+}
+
+// Linear scan over live ranges with holes. The blocks are numbered in reverse
+// post-order; a value lives in a set of ranges of positions, found from block
+// liveness. Intervals are taken by start, each gets a register none of the
+// intervals already there overlaps, the register of a value it is copied
+// from or to when that one is free, so the copy disappears. A value live
+// across a call only gets a saved register. When none is free, the intervals
+// with the least uses per position stay in memory, where the Controller
+// caches them as before.
+void FunctionIR::allocate_registers()
+{
+    tables.clear();
+    auto &var_id = tables.var_id;
+    auto &ptr = tables.ptr;
+    std::vector<Symbol> vars;
+    auto declare = [&](Symbol name)
+    {
+        if (!var_id.count(name))
+            var_id[name] = vars.size(), vars.push_back(name);
+    };
+    for (auto const &arg : args)
+        declare(transform_arg_name(arg));
+    unsigned n = cfg.blocks.size();
+    for (auto block : cfg.blocks)
+        for (auto const &value : block->values)
+        {
+            if (value->op == IROP::NOTE && value->args[0] == sym_decl)
+                declare(value->args[1]);
+            else if (value->op == IROP::ALLOC && value->args[1] == sym_i32)
+                declare(value->args[0]);
+            else if (value->op == IROP::GETPTR || value->op == IROP::GETELEMPTR)
+                ptr[value->args[0]] = true;
+        }
+    unsigned var_num = vars.size(), words = (var_num + 63) / 64;
+    if (!var_num)
+        return;
+
+    std::vector<unsigned> order = block_order(cfg);
+    std::vector<unsigned> depth(n, 0);
+    loop_depth(*super_block, cfg, 0, depth);
+
+    // the accesses of each block in order, with what it reads before writing
+    // (gen) and what it writes (kill); the arguments are written at 1, before
+    // the first instruction
+    std::vector<Access> accesses;
+    std::vector<unsigned> first(n), last(n), from(n), to(n), calls;
+    std::vector<uint64_t> gen(n * words, 0), kill(n * words, 0), live_in(n * words, 0), live_out(n * words, 0);
+    std::vector<double> cost(var_num, 0);
+    std::vector<std::pair<unsigned, unsigned>> copies;
+    auto bit = [&](std::vector<uint64_t> &bits, unsigned b, unsigned v) -> bool { return bits[b * words + v / 64] >> (v % 64) & 1; };
+    auto set_bit = [&](std::vector<uint64_t> &bits, unsigned b, unsigned v) { bits[b * words + v / 64] |= uint64_t(1) << (v % 64); };
+    unsigned k = 1;
+    for (auto b : order)
+    {
+        double weight = 1;
+        for (unsigned d = 0; d < depth[b] && d < 6; d++)
+            weight *= 10;
+        first[b] = accesses.size();
+        from[b] = 2 * k;
+        auto use = [&](Symbol name)
+        {
+            if (!var_id.count(name))
+                return;
+            unsigned v = var_id.at(name);
+            accesses.push_back({2 * k, v, false});
+            cost[v] += weight;
+            if (!bit(kill, b, v))
+                set_bit(gen, b, v);
+        };
+        auto def = [&](Symbol name)
+        {
+            if (!var_id.count(name))
+                return;
+            unsigned v = var_id.at(name);
+            accesses.push_back({2 * k + 1, v, true});
+            cost[v] += weight;
+            set_bit(kill, b, v);
+        };
+        if (b == 0)
+        {
+            from[b] = 1;
+            for (auto const &arg : args)
+            {
+                Symbol name = transform_arg_name(arg);
+                accesses.push_back({1, var_id.at(name), true});
+                set_bit(kill, b, var_id.at(name));
+            }
+        }
+        for (auto const &value : cfg.blocks[b]->values)
+        {
+            if (!value->args.empty() && value->args[value->args.size() - 1] == sym_disgard)
+                continue;
+            if (value->op == IROP::NOTE || value->op == IROP::ALLOC)
+                continue;
+            scan(*value, ptr, use, def);
+            if (value->op == IROP::CALL_INT || value->op == IROP::CALL_VOID)
+                calls.push_back(2 * k);
+            auto const &op_args = value->args;
+            if (value->op == IROP::LOAD && !ptr.count(op_args[1]) && var_id.count(op_args[0]) && var_id.count(op_args[1]))
+                copies.push_back({var_id.at(op_args[0]), var_id.at(op_args[1])});
+            else if (value->op == IROP::STORE && op_args[0] != init_sym && !ptr.count(op_args[1]) && var_id.count(op_args[0]) && var_id.count(op_args[1]))
+                copies.push_back({var_id.at(op_args[1]), var_id.at(op_args[0])});
+            else if (value->op == IROP::ADD && op_args[2] == sym_zero && var_id.count(op_args[0]) && var_id.count(op_args[1]))
+                copies.push_back({var_id.at(op_args[0]), var_id.at(op_args[1])});
+            // block arguments are read by the terminator and the parameters
+            // written after it, all at once
+            if (value->edge_args)
+            {
+                for (int e = 0; e < 2; e++)
+                    for (auto arg : value->edge_args->args[e])
+                        use(arg);
+                for (int e = 0; e < 2; e++)
+                {
+                    auto const &edge = value->edge_args->args[e];
+                    if (edge.empty())
+                        continue;
+                    auto const &params = cfg.blocks[cfg.id(value->args[value->op == IROP::BR ? e + 1 : 0])]->params;
+                    for (unsigned i = 0; i < edge.size(); i++)
+                    {
+                        def(params[i]);
+                        if (var_id.count(edge[i]))
+                            copies.push_back({var_id.at(params[i]), var_id.at(edge[i])});
+                    }
+                }
+            }
+            k++;
+        }
+        last[b] = accesses.size();
+        to[b] = 2 * k - 1;
+    }
+
+    solve_liveness(cfg, order, words, gen, kill, live_in, live_out);
+
+    // ranges from the last block to the first, so each new one goes before
+    // the others of its value
+    std::vector<std::vector<Range>> ranges(var_num);
+    auto add_range = [&](unsigned v, unsigned lo, unsigned hi)
+    {
+        auto &r = ranges[v];
+        if (r.empty() || r.back().from > hi + 1)
+            r.push_back({lo, hi});
+        else
+            r.back().from = std::min(r.back().from, lo), r.back().to = std::max(r.back().to, hi);
+    };
+    for (auto it = order.rbegin(); it != order.rend(); it++)
+    {
+        unsigned b = *it;
+        for (unsigned w = 0; w < words; w++)
+            for (uint64_t bits = live_out[b * words + w]; bits; bits &= bits - 1)
+                add_range(w * 64 + __builtin_ctzll(bits), from[b], to[b]);
+        for (unsigned i = last[b]; i-- > first[b];)
+        {
+            auto const &access = accesses[i];
+            auto &r = ranges[access.var];
+            if (!access.def)
+                add_range(access.var, from[b], access.pos);
+            else if (!r.empty() && r.back().from <= access.pos)
+                r.back().from = access.pos;
+            else
+                r.push_back({access.pos, access.pos});
+        }
+    }
+
+    // the first arguments keep the register they come in when no call is
+    // near, as nothing else is put in a0-a7 but by a call; a5-a7 stay free
+    // for the operands of an instruction the Controller loads
+    std::vector<int> incoming(var_num, -1);
+    for (int i = 0; i < std::min(5, (int)args.size()); i++)
+        incoming[var_id.at(transform_arg_name(args[i]))] = A0_REG + i;
+    std::vector<unsigned> queue;
+    std::vector<double> weight(var_num, 0);
+    std::vector<bool> crosses(var_num, false), near_call(var_num, false);
+    for (unsigned v = 0; v < var_num; v++)
+    {
+        auto &r = ranges[v];
+        if (r.empty())
+            continue;
+        std::reverse(r.begin(), r.end());
+        unsigned length = 0;
+        for (auto const &range : r)
+        {
+            length += range.to - range.from + 1;
+            auto call = std::lower_bound(calls.begin(), calls.end(), range.from - 1);
+            if (call != calls.end() && *call <= range.to)
+                near_call[v] = true;
+            if (call != calls.end() && *call < range.from)
+                call++;
+            if (call != calls.end() && *call + 1 <= range.to)
+                crosses[v] = true;
+        }
+        weight[v] = cost[v] / length;
+        queue.push_back(v);
+    }
+    std::sort(queue.begin(), queue.end(), [&](unsigned a, unsigned b) { return ranges[a].front().from != ranges[b].front().from ? ranges[a].front().from < ranges[b].front().from : a < b; });
+
+    // the values each one is copied from or to
+    std::vector<unsigned> partner_start(var_num + 1, 0), partners(2 * copies.size());
+    for (auto const &copy : copies)
+        partner_start[copy.first + 1]++, partner_start[copy.second + 1]++;
+    for (unsigned v = 0; v < var_num; v++)
+        partner_start[v + 1] += partner_start[v];
+    {
+        std::vector<unsigned> fill(partner_start.begin(), partner_start.end() - 1);
+        for (auto const &copy : copies)
+            partners[fill[copy.first]++] = copy.second, partners[fill[copy.second]++] = copy.first;
+    }
+
+    // what each register holds from the current start on
+    std::vector<unsigned> holding[ALLOC_REG_NUM];
+    std::vector<int> assigned(var_num, -1);
+    bool used[ALLOC_REG_NUM] = {};
+    for (auto cur : queue)
+    {
+        if (incoming[cur] >= 0 && !near_call[cur])
+        {
+            pinned.push_back({vars[cur], incoming[cur]});
+            continue;
+        }
+        unsigned start = ranges[cur].front().from;
+        unsigned lo = crosses[cur] ? CALLER_SAVED_NUM : 0;
+        bool is_free[ALLOC_REG_NUM];
+        int choice = -1;
+        for (unsigned r = lo; r < ALLOC_REG_NUM; r++)
+        {
+            auto &held = holding[r];
+            held.erase(std::remove_if(held.begin(), held.end(), [&](unsigned v) { return ranges[v].back().to < start; }), held.end());
+            is_free[r] = true;
+            for (auto v : held)
+                if (intersects(ranges[v], ranges[cur]))
+                {
+                    is_free[r] = false;
+                    break;
+                }
+            if (is_free[r] && choice < 0)
+                choice = r;
+        }
+        for (unsigned i = partner_start[cur]; i < partner_start[cur + 1]; i++)
+        {
+            int r = assigned[partners[i]];
+            if (r >= (int)lo && is_free[r])
+            {
+                choice = r;
+                break;
+            }
+        }
+        // a saved register costs a store and a load in every call of the
+        // function, more than a value written and read once outside loops
+        if (choice >= (int)CALLER_SAVED_NUM && !used[choice] && cost[cur] <= 2)
+            continue;
+        if (choice < 0)
+        {
+            // the register whose overlapping values are worth the least,
+            // if they are worth less than this one
+            double best = weight[cur];
+            for (unsigned r = lo; r < ALLOC_REG_NUM; r++)
+            {
+                double worst = 0;
+                for (auto v : holding[r])
+                    if (intersects(ranges[v], ranges[cur]))
+                        worst = std::max(worst, weight[v]);
+                if (worst < best)
+                    best = worst, choice = r;
+            }
+            if (choice < 0)
+                continue;
+            auto &held = holding[choice];
+            for (auto v : held)
+                if (intersects(ranges[v], ranges[cur]))
+                    assigned[v] = -1;
+            held.erase(std::remove_if(held.begin(), held.end(), [&](unsigned v) { return assigned[v] < 0; }), held.end());
+        }
+        assigned[cur] = choice;
+        used[choice] = true;
+        holding[choice].push_back(cur);
+    }
+
+    for (unsigned v = 0; v < var_num; v++)
+        if (assigned[v] >= 0)
+            pinned.push_back({vars[v], alloc_regs[assigned[v]]});
+}
+
+// What the Controller needs to spill only what is read again: the values
+// live out of each block and, per block, the instructions reading each value.
+// Values read and written in one block only, written first, are never live
+// out and get no bit.
+void FunctionIR::compute_liveness()
+{
+    tables.clear();
+    auto &var_id = tables.var_id;
+    auto &ptr = tables.ptr;
+    unsigned n = cfg.blocks.size();
+    for (auto block : cfg.blocks)
+        for (auto const &value : block->values)
+            if (value->op == IROP::GETPTR || value->op == IROP::GETELEMPTR)
+                ptr[value->args[0]] = true;
+
+    // the accesses of each block in order, as (value, is a write)
+    std::vector<Symbol> vars;
+    std::vector<unsigned> seen_in;
+    std::vector<bool> wide;
+    std::vector<std::pair<unsigned, bool>> accesses;
+    std::vector<unsigned> first(n + 1);
+    cfg.live_out.assign(n, {});
+    cfg.reads.assign(n, {});
+    for (unsigned b = 0; b < n; b++)
+    {
+        first[b] = accesses.size();
+        unsigned index = 0;
+        auto access = [&](Symbol name, bool def)
+        {
+            if (!symbol_info(name).is_var)
+                return;
+            if (!var_id.count(name))
+            {
+                var_id[name] = vars.size();
+                vars.push_back(name), seen_in.push_back(b), wide.push_back(!def);
+            }
+            unsigned v = var_id.at(name);
+            if (seen_in[v] != b)
+                wide[v] = true;
+            accesses.push_back({v, def});
+            if (!def)
+                cfg.reads[b].push_back({index, name});
+        };
+        auto use = [&](Symbol name) { access(name, false); };
+        auto def = [&](Symbol name) { access(name, true); };
+        if (b == 0)
+            for (auto const &arg : args)
+                def(transform_arg_name(arg));
+        for (auto const &value : cfg.blocks[b]->values)
+        {
+            if (value->args.empty() || value->args[value->args.size() - 1] != sym_disgard)
+                scan(*value, ptr, use, def);
+            if (value->edge_args)
+            {
+                for (int e = 0; e < 2; e++)
+                    for (auto arg : value->edge_args->args[e])
+                        use(arg);
+                for (int e = 0; e < 2; e++)
+                {
+                    auto const &edge = value->edge_args->args[e];
+                    if (edge.empty())
+                        continue;
+                    auto const &params = cfg.blocks[cfg.id(value->args[value->op == IROP::BR ? e + 1 : 0])]->params;
+                    for (unsigned i = 0; i < edge.size(); i++)
+                        def(params[i]);
+                }
+            }
+            index++;
+        }
+    }
+    first[n] = accesses.size();
+
+    std::vector<unsigned> bit_of(vars.size());
+    std::vector<Symbol> wide_vars;
+    for (unsigned v = 0; v < vars.size(); v++)
+        if (wide[v])
+            bit_of[v] = wide_vars.size(), wide_vars.push_back(vars[v]);
+    unsigned words = (wide_vars.size() + 63) / 64;
+    if (!words)
+        return;
+    std::vector<uint64_t> gen(n * words, 0), kill(n * words, 0), live_in(n * words, 0), live_out(n * words, 0);
+    for (unsigned b = 0; b < n; b++)
+        for (unsigned i = first[b]; i < first[b + 1]; i++)
+        {
+            if (!wide[accesses[i].first])
+                continue;
+            unsigned v = bit_of[accesses[i].first];
+            uint64_t mask = uint64_t(1) << (v % 64);
+            if (accesses[i].second)
+                kill[b * words + v / 64] |= mask;
+            else if (!(kill[b * words + v / 64] & mask))
+                gen[b * words + v / 64] |= mask;
+        }
+    solve_liveness(cfg, block_order(cfg), words, gen, kill, live_in, live_out);
+    for (unsigned b = 0; b < n; b++)
+        for (unsigned w = 0; w < words; w++)
+            for (uint64_t bits = live_out[b * words + w]; bits; bits &= bits - 1)
+                cfg.live_out[b].push_back(wide_vars[w * 64 + __builtin_ctzll(bits)]);
+}
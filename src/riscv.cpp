@@ -1,9 +1,12 @@
 #include <riscv.h>
+#include <ir.h>
 #include <iostream>
 #include <str.h>
 #include <random>
 #include <cassert>
 #include <algorithm>
+#include <string_view>
+#include <timer.h>
 
 const std::string reg_names[REG_NUM] = {
     "zero", "ra", "sp", "gp", "tp",
@@ -24,6 +27,13 @@ const int saved_regs[SAVED_REG_NUM] = {
     18, 19, 20, 21, 22, 23, 24, 25, 26, 27, // s2-11
 };
 
+const Symbol t6_sym = intern("!t6");
+const Symbol zero_sym = intern("!zero");
+
+Annotation annotation = Annotation::NONE;
+std::string annotation_file;
+bool mark_spills = false;
+
 int regname_to_idx(const std::string name)
 {
     for (int i = 0; i < REG_NUM; i++)
@@ -44,7 +54,7 @@ void safe_mem(const std::string op, const std::string reg_name, const int loc, R
     }
 }
 
-void Controller::var_mem(const std::string op, const std::string name, const std::string reg_name, RISCV &riscv)
+void Controller::var_mem(const std::string op, const Symbol name, const std::string reg_name, RISCV &riscv)
 {
     if (glob->global_var.count(name))
     {
@@ -52,14 +62,22 @@ void Controller::var_mem(const std::string op, const std::string name, const std
         riscv.text.push_back({op, reg_name, "0(t5)"});
     }
     else
+    {
+        if (symbol_info(name).is_var)
+        {
+            (op == "sw" ? spill_stores : spill_loads)++;
+            if (mark_spills)
+                riscv.text.push_back({"# spill"});
+        }
         safe_mem(op, reg_name, func->get_save_pos(name), riscv);
+    }
 }
 
-std::string transform_arg_name(const std::string name)
+Symbol transform_arg_name(const std::string name)
 {
     if (start_with(name, "%"))
-        return "@" + name.substr(5, name.find(":") - 5);
-    return name.substr(0, name.find(":"));
+        return intern("@" + name.substr(5, name.find(":") - 5));
+    return intern(name.substr(0, name.find(":")));
 }
 
 void Controller::clear(const std::vector<std::string> &args)
@@ -70,18 +88,23 @@ void Controller::clear(const std::vector<std::string> &args)
     reg_pos.clear();
     current_save.clear();
     for (int i = 1; i < SAVED_REG_NUM; i++)
-        current_save.insert({"saved " + std::to_string(i), saved_regs[i]});
+        current_save.insert({intern("saved " + std::to_string(i)), saved_regs[i]});
     label_set.clear();
-    func->mem_need = 4 * SAVED_REG_NUM;
-    reg_in_use[0] = "zero";
-    reg_in_use[1] = "return address";
-    reg_in_use[2] = "stack pointer";
-    reg_in_use[3] = "global pointer";
-    reg_in_use[4] = "thread pointer";
+    label_count = 0;
+    loc_line = 0;
+    func->mem_need = FP_SAVE_POS;
+    func->out_args = 0;
+    for (int i = 0; i < REG_NUM; i++)
+        dirty[i] = false;
+    reg_in_use[0] = intern("zero");
+    reg_in_use[1] = intern("return address");
+    reg_in_use[2] = intern("stack pointer");
+    reg_in_use[3] = intern("global pointer");
+    reg_in_use[4] = intern("thread pointer");
     for (int i = 0; i < 3; i++)
         reg_in_use[i + 5] = std::nullopt;
-    reg_in_use[8] = "frame pointer";
-    reg_in_use[9] = "saved 1";
+    reg_in_use[8] = intern("frame pointer");
+    reg_in_use[9] = intern("saved 1");
     for (int i = 0; i < std::min(8, argc); i++)
     {
         bind(reg_names[i + 10], transform_arg_name(args[i]));
@@ -92,24 +115,62 @@ void Controller::clear(const std::vector<std::string> &args)
     for (int i = argc; i < 8; i++)
         reg_in_use[i + 10] = std::nullopt;
     for (int i = 2; i < 12; i++)
-        reg_in_use[i + 16] = "saved " + std::to_string(i);
+        reg_in_use[i + 16] = intern("saved " + std::to_string(i));
     for (int i = 3; i < 7; i++)
         reg_in_use[i + 25] = std::nullopt;
     current_time = 0;
     for (int i = 0; i < REG_NUM; i++)
-        last_used[i] = 0;
+        last_used[i] = 0, reserved[i] = false;
+    pinned.clear();
+    pinned_saved.clear();
+    live_out.clear();
+    last_read.clear();
+    position = 0;
+    operands_read = false;
+    current_block = 0;
+    left_in_regs.clear();
 }
 
-void Controller::refresh(RISCV &riscv, bool save, std::vector<std::string> except)
+void Controller::pin(const std::vector<std::pair<Symbol, int>> &assignment, RISCV &riscv)
+{
+    for (auto const &it : assignment)
+    {
+        pinned[it.first] = it.second;
+        reserved[it.second] = true;
+    }
+    for (int i = 1; i < SAVED_REG_NUM; i++)
+        if (reserved[saved_regs[i]])
+        {
+            pinned_saved.push_back(i);
+            safe_mem("sw", reg_names[saved_regs[i]], (i + 1) * 4, riscv);
+        }
+    // the arguments get distinct registers, of a0-a7 only the one they are in
+    for (auto const &it : assignment)
+        if (func->save_pos.count(it.first))
+        {
+            if (reg_pos[it.first].has_value())
+            {
+                int reg = reg_pos[it.first].value();
+                if (reg != it.second)
+                    riscv.text.push_back({"mv", reg_names[it.second], reg_names[reg]});
+                reg_in_use[reg] = std::nullopt;
+                reg_pos[it.first] = std::nullopt;
+            }
+            else
+                var_mem("lw", it.first, reg_names[it.second], riscv);
+        }
+}
+
+void Controller::refresh(RISCV &riscv, bool save, std::vector<Symbol> except)
 {
     for (int i = 0; i < FREE_REG_NUM; i++)
     {
         int idx = free_regs[i];
         if (reg_in_use[idx].has_value())
         {
-            if (!is_allocvar(reg_in_use[idx].value()) && std::find(except.begin(), except.end(), reg_in_use[idx].value()) != except.end())
+            if (!symbol_info(reg_in_use[idx].value()).is_allocvar && std::find(except.begin(), except.end(), reg_in_use[idx].value()) != except.end())
                 continue;
-            if (save || glob->global_var.count(reg_in_use[idx].value()))
+            if ((save || glob->global_var.count(reg_in_use[idx].value())) && needs_store(idx))
                 var_mem("sw", reg_in_use[idx].value(), reg_names[idx], riscv);
             reg_pos[reg_in_use[idx].value()] = std::nullopt;
             reg_in_use[idx] = std::nullopt;
@@ -120,36 +181,50 @@ void Controller::refresh(RISCV &riscv, bool save, std::vector<std::string> excep
         last_used[i] = 0;
 }
 
-void Controller::transition(RISCV &riscv, std::string mode)
+void Controller::transition(RISCV &riscv, std::string mode, const Symbol callee)
 {
+    if (!glob->effects.count(callee))
+        return;
+    auto const &effects = glob->effects.at(callee);
+    auto touches = [](const std::vector<Symbol> &names, Symbol name) { return std::binary_search(names.begin(), names.end(), name); };
     for (auto &pair : current_save)
-        if (glob->global_var.count(pair.first))
+        if (glob->global_var.count(pair.first) && (mode == "lw" || dirty[pair.second]) && (touches(effects.writes, pair.first) || (mode == "sw" && touches(effects.reads, pair.first))))
             var_mem(mode, pair.first, reg_names[pair.second], riscv);
 }
 
+void Controller::mark_line(unsigned line, RISCV &riscv)
+{
+    if (!line || line == loc_line)
+        return;
+    loc_line = line;
+    riscv.text.push_back({".loc 1 " + std::to_string(line)});
+}
+
 void Controller::prepare_return(RISCV &riscv)
 {
     for (auto const &i : current_save)
     {
-        if (glob->global_var.count(i.first))
+        if (glob->global_var.count(i.first) && dirty[i.second])
             var_mem("sw", i.first, reg_names[i.second], riscv);
         for (int j = 1; j < SAVED_REG_NUM; j++)
-            if (i.second == saved_regs[j] && !start_with(i.first, "saved "))
+            if (i.second == saved_regs[j] && !start_with(symbol_name(i.first), "saved "))
                 riscv.text.push_back({"lw", reg_names[i.second], std::to_string(-(j + 1) * 4) + "(fp)"});
     }
-    return;
+    for (int i : pinned_saved)
+        riscv.text.push_back({"lw", reg_names[saved_regs[i]], std::to_string(-(i + 1) * 4) + "(fp)"});
 }
 
-void Controller::bind(const std::string reg, const std::string name)
+void Controller::bind(const std::string reg, const Symbol name)
 {
     reg_in_use[regname_to_idx(reg)] = name;
     reg_pos[name] = regname_to_idx(reg);
+    dirty[regname_to_idx(reg)] = true;
     last_used[regname_to_idx(reg)] = current_time++;
 }
 
-void Controller::alloc(const std::string name, RISCV &riscv, bool reg, int size)
+void Controller::alloc(const Symbol name, RISCV &riscv, bool reg, int size)
 {
-    if (func->save_pos.count(name))
+    if (func->save_pos.count(name) || pinned.count(name))
         return;
     if (size != 4)
         reg = false;
@@ -162,10 +237,11 @@ void Controller::alloc(const std::string name, RISCV &riscv, bool reg, int size)
         for (int i = 0; i < FREE_REG_NUM; i++)
         {
             int idx = free_regs[i];
-            if (!reg_in_use[idx].has_value())
+            if (!reg_in_use[idx].has_value() && !reserved[idx])
             {
                 reg_in_use[idx] = name;
                 reg_pos[name] = idx;
+                dirty[idx] = false;
                 last_used[idx] = current_time++;
                 return;
             }
@@ -180,7 +256,7 @@ int Controller::find_lru()
     for (int i = 0; i < FREE_REG_NUM; i++)
     {
         int idx = free_regs[i];
-        if (last_used[idx] < min_time)
+        if (last_used[idx] < min_time && !reserved[idx])
         {
             min_time = last_used[idx];
             min_idx = idx;
@@ -189,11 +265,24 @@ int Controller::find_lru()
     return min_idx;
 }
 
+// Only a variable read again and changed since it was loaded is stored;
+// anything else a register holds, like the caller's saved registers, always.
+bool Controller::needs_store(int reg) const
+{
+    Symbol name = reg_in_use[reg].value();
+    if (!symbol_info(name).is_var)
+        return true;
+    if (!dirty[reg])
+        return false;
+    return glob->global_var.count(name) || live_out.count(name) || (last_read.count(name) && last_read.at(name) >= position + operands_read);
+}
+
 void Controller::save_back(int reg, RISCV &riscv, bool sync)
 {
     if (reg_in_use[reg].has_value())
     {
-        var_mem("sw", reg_in_use[reg].value(), reg_names[reg], riscv);
+        if (needs_store(reg))
+            var_mem("sw", reg_in_use[reg].value(), reg_names[reg], riscv);
         if (sync)
         {
             reg_pos[reg_in_use[reg].value()] = std::nullopt;
@@ -207,7 +296,7 @@ int Controller::find_reg(RISCV &riscv)
     for (int i = 0; i < FREE_REG_NUM; i++)
     {
         int idx = free_regs[i];
-        if (!reg_in_use[idx].has_value())
+        if (!reg_in_use[idx].has_value() && !reserved[idx])
         {
             last_used[idx] = current_time++;
             return idx;
@@ -221,47 +310,79 @@ int Controller::find_reg(RISCV &riscv)
     return reg;
 }
 
-int Controller::load(const std::string name, RISCV &riscv, bool load, int specify)
+// a free register for scratch use within one instruction, until give_back
+int Controller::borrow(RISCV &riscv)
+{
+    static const Symbol scratch = intern("!scratch");
+    int reg = find_reg(riscv);
+    reg_in_use[reg] = scratch;
+    return reg;
+}
+
+void Controller::give_back(int reg)
+{
+    reg_in_use[reg] = std::nullopt;
+}
+
+int Controller::load(const Symbol name, RISCV &riscv, bool load, int specify)
 {
+    // a pinned value is always in its register; a specific one gets a copy
+    if (pinned.count(name))
+    {
+        int reg = pinned.at(name);
+        if (!specify || specify == reg)
+            return reg;
+        save_back(specify, riscv, true);
+        riscv.text.push_back({"mv", reg_names[specify], reg_names[reg]});
+        last_used[specify] = current_time++;
+        return specify;
+    }
     if (specify)
     {
         if (reg_pos[name].has_value() && reg_pos[name].value() == specify)
         {
-            last_used[reg_pos[name].value()] = current_time++;
-            return reg_pos[name].value();
-        }
-        if (reg_in_use[specify].has_value())
-        {
-            var_mem("sw", reg_in_use[specify].value(), reg_names[specify], riscv);
-            reg_pos[reg_in_use[specify].value()] = std::nullopt;
-            reg_in_use[specify] = std::nullopt;
+            last_used[specify] = current_time++;
+            dirty[specify] |= !load;
+            return specify;
         }
+        save_back(specify, riscv, true);
         if (reg_pos[name].has_value())
         {
-            riscv.text.push_back({"mv", reg_names[specify], reg_names[reg_pos[name].value()]});
-            reg_in_use[reg_pos[name].value()] = std::nullopt;
+            int reg = reg_pos[name].value();
+            riscv.text.push_back({"mv", reg_names[specify], reg_names[reg]});
+            dirty[specify] = dirty[reg];
+            // a variable the super block keeps in a saved register stays
+            // there; the copy is only for this use
+            if (current_save.count(name) && (int)current_save.at(name) == reg)
+            {
+                last_used[specify] = current_time++;
+                return specify;
+            }
+            reg_in_use[reg] = std::nullopt;
         }
         else
-            var_mem("lw", name, reg_names[specify], riscv);
+            var_mem("lw", name, reg_names[specify], riscv), dirty[specify] = false;
         last_used[specify] = current_time++;
         reg_in_use[specify] = name;
         reg_pos[name] = specify;
     }
 
-    if (name == "!t6")
+    if (name == t6_sym)
         return T6_REG;
-    if (name == "!zero")
+    if (name == zero_sym)
         return ZERO_REG;
 
     if (reg_pos[name].has_value())
     {
         last_used[reg_pos[name].value()] = current_time++;
+        dirty[reg_pos[name].value()] |= !load;
         return reg_pos[name].value();
     }
 
     int reg = find_reg(riscv);
     reg_in_use[reg] = name;
     reg_pos[name] = reg;
+    dirty[reg] = !load;
 
     if (load)
         var_mem("lw", name, reg_names[reg], riscv);
@@ -269,9 +390,9 @@ int Controller::load(const std::string name, RISCV &riscv, bool load, int specif
     return reg;
 }
 
-void Controller::try_invalidate(const std::string name)
+void Controller::try_invalidate(const Symbol name)
 {
-    if (is_allocvar(name))
+    if (symbol_info(name).is_allocvar)
         return;
     if (reg_pos[name].has_value())
     {
@@ -298,39 +419,220 @@ void RISCV::to_string(std::string &str) const
                 content += ",";
             content += " ";
         }
-        if (start_with(content, "entry:"))
-            content = "";
         new_line(str, content, tabs);
     }
 }
 
+void RISCV::emit()
+{
+    PhaseTimer timer("riscv.emit");
+    to_string(buffer);
+    text.clear();
+    if (buffer.size() >= EMIT_BUFFER_SIZE)
+        flush();
+}
+
+void RISCV::write(const std::string &str)
+{
+    buffer += str;
+    if (buffer.size() >= EMIT_BUFFER_SIZE)
+        flush();
+}
+
+void RISCV::flush()
+{
+    if (!out)
+        return;
+    out->write(buffer.data(), buffer.size());
+    if (echo)
+        echo->write(buffer.data(), buffer.size());
+    buffer.clear();
+}
+
 void FuncRISCVINFO::init_save_reg()
 {
     for (int i = 1; i < SAVED_REG_NUM; i++)
-        save_pos["saved " + std::to_string(i)] = (i + 1) * 4;
+        save_pos[intern("saved " + std::to_string(i))] = (i + 1) * 4;
 }
 
-void Controller::checkout(std::unordered_map<std::string, unsigned> &new_set, RISCV &riscv, bool l)
+void Controller::checkout(const SaveMap &new_set, RISCV &riscv, bool l)
 {
-    std::unordered_map<std::string, unsigned> old_current_save = current_save;
+    SaveMap old_current_save = current_save;
     current_save.clear();
     for (auto i : new_set)
     {
-        if (!(old_current_save.count(i.first) && old_current_save.at(i.first) == i.second && start_with(i.first, "saved ")))
+        bool stays = old_current_save.count(i.first) && old_current_save.at(i.first) == i.second;
+        if (!(stays && start_with(symbol_name(i.first), "saved ")))
         {
+            bool was_dirty = dirty[i.second];
             alloc(i.first, riscv, false);
             load(i.first, riscv, l, i.second);
+            // the blocks are not lowered in the order they run, so whether
+            // a saved register is newer than memory is not known at its end
+            dirty[i.second] = !stays || was_dirty || dirty[i.second];
         }
         current_save.insert({i.first, i.second});
     }
 }
 
-bool Controller::has_set_label(std::string name) const
+void Controller::enter_block(unsigned block)
+{
+    current_block = block;
+    live_out.clear();
+    last_read.clear();
+    position = 0;
+    operands_read = false;
+    for (auto name : cfg->live_out[block])
+        live_out[name] = true;
+    for (auto const &read : cfg->reads[block])
+        last_read[read.second] = read.first;
+}
+
+// Every successor taking the registers over gets the values still to be
+// stored as they are, and stores them only on the paths that read them again.
+void Controller::leave_block()
+{
+    bool handed_over = true;
+    for (auto succ : cfg->succs[current_block])
+        handed_over &= cfg->preds[succ].size() == 1 && !cfg->is_loop_exit[succ] && cfg->loop_exit[succ] == CFG::NONE;
+    auto &left = left_in_regs[current_block];
+    left.clear();
+    // a dirty value the refresh does not store is dead, the rest match memory
+    for (int i = 0; i < FREE_REG_NUM; i++)
+    {
+        int idx = free_regs[i];
+        if (!reg_in_use[idx].has_value() || !symbol_info(reg_in_use[idx].value()).is_var || (dirty[idx] && !needs_store(idx)))
+            continue;
+        left.push_back({idx, reg_in_use[idx].value(), dirty[idx] && handed_over});
+        if (handed_over)
+            dirty[idx] = false;
+    }
+}
+
+void Controller::inherit(unsigned block, RISCV &riscv)
+{
+    if (cfg->preds[block].size() != 1 || !left_in_regs.count(cfg->preds[block][0]))
+        return;
+    for (auto const &it : left_in_regs.at(cfg->preds[block][0]))
+    {
+        if (!reg_in_use[it.reg].has_value() && !(reg_pos.count(it.name) && reg_pos.at(it.name).has_value()))
+        {
+            reg_in_use[it.reg] = it.name;
+            reg_pos[it.name] = it.reg;
+            dirty[it.reg] = it.dirty;
+            last_used[it.reg] = current_time++;
+        }
+        // nothing has run since the branch, so the register still holds it
+        else if (it.dirty)
+            var_mem("sw", it.name, reg_names[it.reg], riscv);
+    }
+}
+
+// Bytes an assembly line takes, at most: li of a large constant, la and call
+// expand to two instructions; labels, comments and directives take none.
+static unsigned code_size(const std::vector<std::string> &line)
+{
+    if (line.empty() || line[0].empty() || line[0][0] == '.' || line[0][0] == '#' || line[0].back() == ':')
+        return 0;
+    if (line[0] == "li")
+    {
+        if (line.size() < 3 || !is_num(line[2]))
+            return 8;
+        long long imm = std::stoll(line[2]);
+        return imm >= -IMM12_MAX && imm < IMM12_MAX ? 4 : 8;
+    }
+    if (line[0] == "la" || line[0] == "call")
+        return 8;
+    return 4;
+}
+
+// the conditional branches generated, each with the one taken on the opposite condition
+static const std::unordered_map<std::string, std::string> inverse_branch = {
+    {"beqz", "bnez"}, {"bnez", "beqz"}, {"blt", "bge"}, {"bge", "blt"}};
+// how far a conditional branch reaches, in bytes either way
+static const long long BRANCH_RANGE = 4096;
+
+void Controller::relax_branches(RISCV &riscv)
+{
+    PhaseTimer timer("riscv.relax");
+    auto &text = riscv.text;
+    using Line = List<std::vector<std::string>>::iterator;
+    auto is_branch = [](const std::vector<std::string> &line) { return !line.empty() && line[0].size() == 4 && line[0][0] == 'b' && inverse_branch.count(line[0]); };
+    // whether control reaches the label from it with no instruction between
+    auto falls_to = [&](Line it, const std::string &label)
+    {
+        for (; it != text.end() && !code_size(*it); it++)
+            if (it->size() == 1 && it->front().size() == label.size() + 1 && it->front().back() == ':' && it->front().compare(0, label.size(), label) == 0)
+                return true;
+        return false;
+    };
+    // labels by address, and the branches with their own
+    std::unordered_map<std::string_view, long long> address;
+    std::vector<std::pair<Line, long long>> branches;
+    auto note = [&](Line it, long long pos)
+    {
+        if (is_branch(*it))
+            branches.push_back({it, pos});
+        else if (it->size() == 1 && it->front().back() == ':' && it->front()[0] != '#')
+            address[std::string_view(it->front()).substr(0, it->front().size() - 1)] = pos;
+    };
+    long long pos = 0;
+    for (auto it = text.begin(); it != text.end();)
+    {
+        auto next = std::next(it);
+        if (is_branch(*it) && next != text.end() && next->size() == 2 && next->front() == "j" && falls_to(std::next(next), it->back()))
+        {
+            it->front() = inverse_branch.at(it->front());
+            it->back() = next->back();
+            text.erase(next);
+            continue;
+        }
+        if (it->size() == 2 && it->front() == "j" && falls_to(next, it->back()))
+        {
+            it = text.erase(it);
+            continue;
+        }
+        note(it, pos);
+        pos += code_size(*it);
+        it = next;
+    }
+
+    // a branch put out of reach only moves code further apart, so this ends
+    for (bool changed = false;; changed = false)
+    {
+        for (auto const &branch : branches)
+        {
+            auto target = address.find(branch.first->back());
+            if (target == address.end())
+                continue;
+            long long offset = target->second - branch.second;
+            if (offset >= -BRANCH_RANGE && offset < BRANCH_RANGE)
+                continue;
+            std::string skip = new_label("labellongjump");
+            Line it = branch.first;
+            std::string label = it->back();
+            it->front() = inverse_branch.at(it->front());
+            it->back() = skip;
+            it = text.insert(std::next(it), {"j", label});
+            text.insert(std::next(it), {skip + ":"});
+            changed = true;
+        }
+        if (!changed)
+            break;
+        address.clear();
+        branches.clear();
+        pos = 0;
+        for (auto it = text.begin(); it != text.end(); it++)
+            note(it, pos), pos += code_size(*it);
+    }
+}
+
+bool Controller::has_set_label(const Symbol name) const
 {
     return label_set.count(name);
 }
 
-void Controller::set_label(std::string name)
+void Controller::set_label(const Symbol name)
 {
     label_set.insert(name);
 }
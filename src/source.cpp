@@ -0,0 +1,60 @@
+#include <source.h>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+bool SourceBuffer::open(const std::string path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode))
+    {
+        ::close(fd);
+        return false;
+    }
+    size = st.st_size;
+    size_t page = sysconf(_SC_PAGESIZE);
+    // the kernel zero-fills the rest of the last page, so the terminators
+    // come for free unless the file ends within two bytes of a page boundary
+    if (size % page && size % page <= page - 2)
+    {
+        void *addr = mmap(nullptr, size + 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (addr != MAP_FAILED)
+        {
+            ::close(fd);
+            data = static_cast<char *>(addr);
+            mapped_size = size + 2;
+            mapped = true;
+            return true;
+        }
+    }
+    data = new char[size + 2];
+    size_t done = 0;
+    while (done < size)
+    {
+        ssize_t got = read(fd, data + done, size - done);
+        if (got <= 0)
+            break;
+        done += got;
+    }
+    ::close(fd);
+    size = done;
+    data[size] = data[size + 1] = '\0';
+    return true;
+}
+
+void SourceBuffer::close()
+{
+    if (mapped)
+        munmap(data, mapped_size);
+    else
+        delete[] data;
+    data = nullptr;
+    size = mapped_size = 0;
+    mapped = false;
+}
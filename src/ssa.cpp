@@ -0,0 +1,381 @@
+#include <ir.h>
+#include <timer.h>
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+bool mem2reg_enabled = true;
+
+static const Symbol sym_zero = intern("0");
+static const Symbol sym_i32 = intern("i32");
+static const Symbol sym_decl = intern("decl");
+
+// position of the value an instruction defines, -1 if it defines none
+static int def_index(IROP op)
+{
+    if (op == IROP::CALL_INT)
+        return 1;
+    if (op == IROP::LOAD || op == IROP::GETPTR || op == IROP::GETELEMPTR || get_irop_info(op).binary)
+        return 0;
+    return -1;
+}
+
+// The backend cannot take two constant operands, which appear once loads are
+// replaced by the constants stored before them. Wraps like the target does;
+// division by zero is undefined and gives 0.
+static int fold(IROP op, int64_t a, int64_t b)
+{
+    int64_t result = 0;
+    switch (op)
+    {
+    case IROP::ADD: result = a + b; break;
+    case IROP::SUB: result = a - b; break;
+    case IROP::MUL: result = a * b; break;
+    case IROP::DIV: result = b ? a / b : 0; break;
+    case IROP::MOD: result = b ? a % b : 0; break;
+    case IROP::AND: result = a & b; break;
+    case IROP::OR: result = a | b; break;
+    case IROP::XOR: result = a ^ b; break;
+    case IROP::EQ: result = a == b; break;
+    case IROP::NE: result = a != b; break;
+    case IROP::LT: result = a < b; break;
+    case IROP::GT: result = a > b; break;
+    case IROP::LE: result = a <= b; break;
+    case IROP::GE: result = a >= b; break;
+    default: assert(0);
+    }
+    return (int32_t)(uint32_t)result;
+}
+
+namespace
+{
+// tables of one function, kept per thread so their storage is reused
+struct Tables
+{
+    SymbolMap<unsigned> var_id, uses, param_index;
+    SymbolMap<Symbol> replace;
+    SymbolMap<bool> dead, ssa;
+    SymbolMap<ValueIR *> defined;
+    // %alloc_ssa_<n> by n; every function uses the same names
+    std::vector<Symbol> names;
+    void clear()
+    {
+        var_id.clear(), uses.clear(), param_index.clear();
+        replace.clear(), dead.clear(), ssa.clear(), defined.clear();
+    }
+};
+thread_local Tables tables;
+}
+
+// Scalar allocs that are only loaded and stored become SSA values: block
+// parameters go on the iterated dominance frontier where the variable is live,
+// then a walk of the dominator tree replaces loads by the reaching value and
+// passes values along the edges. The new values are named %alloc_ssa_<n>, so
+// the backend keeps them in registers across uses like the variables they
+// replace. Function arguments stay in their allocs.
+void FunctionIR::mem2reg()
+{
+    PhaseTimer timer("mem2reg", &name);
+
+    // Blocks the entry cannot reach are never renamed, so they go. The exit
+    // of a loop that never ends stays, as the backend places it after the
+    // loop, but it only needs to return.
+    if (cfg.rpo.size() < cfg.blocks.size())
+    {
+        std::vector<bool> keep(cfg.blocks.size(), false);
+        for (auto b : cfg.rpo)
+            keep[b] = true;
+        for (auto b : cfg.rpo)
+        {
+            unsigned exit = cfg.loop_exit[b];
+            if (exit == CFG::NONE || keep[exit])
+                continue;
+            keep[exit] = true;
+            cfg.blocks[exit]->values.clear();
+            auto ret = make_arena<ValueIR>(*pool, *pool, IROP::RET);
+            if (return_type == "int")
+                ret->args.push_back(sym_zero);
+            cfg.blocks[exit]->values.push_back(std::move(ret));
+        }
+        unsigned i = 0;
+        for (auto it = base_blocks.begin(); it != base_blocks.end(); i++)
+            it = keep[i] ? std::next(it) : base_blocks.erase(it);
+        cfg.retain(keep);
+    }
+    cfg.build_dominators();
+    unsigned n = cfg.blocks.size();
+    BaseBlockIR *entry = cfg.blocks[0];
+
+    // candidates are the i32 allocs of the entry block; one used anywhere but
+    // as the address of a load or store escapes
+    tables.clear();
+    auto &var_id = tables.var_id;
+    auto &uses = tables.uses;
+    std::vector<Symbol> vars;
+    for (auto const &value : entry->values)
+        if (value->op == IROP::ALLOC && value->args.size() == 2 && value->args[1] == sym_i32)
+            var_id[value->args[0]] = vars.size(), vars.push_back(value->args[0]);
+    std::vector<bool> escapes(vars.size(), false);
+    for (auto block : cfg.blocks)
+        for (auto const &value : block->values)
+        {
+            if (value->op == IROP::NOTE)
+                continue;
+            int def = def_index(value->op);
+            bool access = value->op == IROP::LOAD || (value->op == IROP::STORE && value->args[0] != init_sym);
+            for (unsigned i = 0; i < value->args.size(); i++)
+            {
+                if (var_id.count(value->args[i]))
+                {
+                    if (value->op != IROP::ALLOC && !(access && i == 1))
+                        escapes[var_id.at(value->args[i])] = true;
+                }
+                else if ((int)i != def)
+                    uses[value->args[i]]++;
+            }
+        }
+    {
+        std::vector<Symbol> promoted;
+        for (unsigned v = 0; v < vars.size(); v++)
+            if (!escapes[v])
+                promoted.push_back(vars[v]);
+        vars = std::move(promoted);
+        var_id.clear();
+        for (unsigned v = 0; v < vars.size(); v++)
+            var_id[vars[v]] = v;
+    }
+    if (vars.empty())
+        return;
+    unsigned var_num = vars.size(), words = (var_num + 63) / 64;
+
+    // upward-exposed loads and stores of each block, then liveness
+    std::vector<uint64_t> use_bits(n * words, 0), def_bits(n * words, 0), live_in(n * words, 0);
+    auto bit = [&](std::vector<uint64_t> &bits, unsigned b, unsigned v) -> bool { return bits[b * words + v / 64] >> (v % 64) & 1; };
+    auto set_bit = [&](std::vector<uint64_t> &bits, unsigned b, unsigned v) { bits[b * words + v / 64] |= uint64_t(1) << (v % 64); };
+    // the blocks storing to each variable, as (variable, block)
+    std::vector<std::pair<unsigned, unsigned>> defs;
+    for (unsigned b = 0; b < n; b++)
+        for (auto const &value : cfg.blocks[b]->values)
+        {
+            if (value->op != IROP::LOAD && value->op != IROP::STORE)
+                continue;
+            if (!var_id.count(value->args[1]))
+                continue;
+            unsigned v = var_id.at(value->args[1]);
+            if (value->op == IROP::STORE && !bit(def_bits, b, v))
+                set_bit(def_bits, b, v), defs.push_back({v, b});
+            else if (!bit(def_bits, b, v))
+                set_bit(use_bits, b, v);
+        }
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (auto it = cfg.rpo.rbegin(); it != cfg.rpo.rend(); it++)
+            for (unsigned w = 0; w < words; w++)
+            {
+                uint64_t out = 0;
+                for (auto succ : cfg.succs[*it])
+                    out |= live_in[succ * words + w];
+                uint64_t in = use_bits[*it * words + w] | (out & ~def_bits[*it * words + w]);
+                if (in != live_in[*it * words + w])
+                    live_in[*it * words + w] = in, changed = true;
+            }
+    }
+
+    // parameters on the iterated dominance frontier of the stores, where the
+    // variable is live, as (block, variable) in the order of the variables
+    std::sort(defs.begin(), defs.end());
+    std::vector<std::pair<unsigned, unsigned>> placed;
+    std::vector<unsigned> queued(n, CFG::NONE), has_param(n, CFG::NONE);
+    std::vector<unsigned> work;
+    for (size_t i = 0; i < defs.size();)
+    {
+        unsigned v = defs[i].first;
+        for (; i < defs.size() && defs[i].first == v; i++)
+            queued[defs[i].second] = v, work.push_back(defs[i].second);
+        while (!work.empty())
+        {
+            unsigned b = work.back();
+            work.pop_back();
+            for (auto d : cfg.frontier[b])
+            {
+                if (has_param[d] == v || !bit(live_in, d, v))
+                    continue;
+                has_param[d] = v;
+                placed.push_back({d, v});
+                if (queued[d] != v)
+                    queued[d] = v, work.push_back(d);
+            }
+        }
+    }
+    std::sort(placed.begin(), placed.end());
+    unsigned ssa_count = 0;
+    std::vector<Symbol> new_names;
+    auto &ssa_names = tables.ssa;
+    auto fresh = [&]()
+    {
+        if (ssa_count == tables.names.size())
+            tables.names.push_back(intern("%alloc_ssa_" + std::to_string(ssa_count)));
+        Symbol sym = tables.names[ssa_count++];
+        new_names.push_back(sym);
+        ssa_names[sym] = true;
+        return sym;
+    };
+    std::vector<std::vector<unsigned>> param_var(n);
+    for (auto [b, v] : placed)
+    {
+        tables.param_index[fresh()] = param_var[b].size();
+        param_var[b].push_back(v);
+        cfg.blocks[b]->params.push_back(new_names.back());
+    }
+
+    // renaming, in preorder of the dominator tree; cur holds the value each
+    // variable has, and the log undoes a block's changes once its subtree is done
+    std::vector<Symbol> cur(var_num, sym_zero);
+    std::vector<std::pair<unsigned, Symbol>> log;
+    auto &replace = tables.replace;
+    auto &dead = tables.dead;
+    auto &defined = tables.defined;
+    auto assign = [&](unsigned v, Symbol value)
+    {
+        log.push_back({v, cur[v]});
+        cur[v] = value;
+    };
+    auto copy_of = [&](Symbol value, unsigned line)
+    {
+        auto copy = make_arena<ValueIR>(*pool, *pool, IROP::ADD);
+        copy->args = {fresh(), value, sym_zero};
+        copy->line = line;
+        return copy;
+    };
+    std::vector<std::pair<unsigned, size_t>> stack = {{0, SIZE_MAX}};
+    while (!stack.empty())
+    {
+        auto [b, mark] = stack.back();
+        stack.pop_back();
+        if (mark != SIZE_MAX)
+        {
+            for (; log.size() > mark; log.pop_back())
+                cur[log.back().first] = log.back().second;
+            continue;
+        }
+        stack.push_back({b, log.size()});
+        BaseBlockIR *block = cfg.blocks[b];
+        for (unsigned i = 0; i < block->params.size(); i++)
+            assign(param_var[b][i], block->params[i]);
+        defined.clear();
+        for (auto it = block->values.begin(); it != block->values.end();)
+        {
+            ValueIR &value = **it;
+            if (value.op == IROP::NOTE)
+            {
+                it++;
+                continue;
+            }
+            for (auto &arg : value.args)
+                if (replace.count(arg))
+                    arg = replace.at(arg);
+            if (value.op == IROP::LOAD && var_id.count(value.args[1]))
+            {
+                replace[value.args[0]] = cur[var_id.at(value.args[1])];
+                dead[value.args[0]] = true;
+                it = block->values.erase(it);
+                continue;
+            }
+            if (value.op == IROP::STORE && value.args[0] != init_sym && var_id.count(value.args[1]))
+            {
+                Symbol stored = value.args[0];
+                unsigned v = var_id.at(value.args[1]);
+                if (symbol_info(stored).is_num || ssa_names.count(stored))
+                    assign(v, stored);
+                else if (defined.count(stored) && uses[stored] == 1)
+                {
+                    // the store is the only use, so the value itself is renamed
+                    ValueIR *def = defined.at(stored);
+                    def->args[def_index(def->op)] = fresh();
+                    dead[stored] = true;
+                    assign(v, new_names.back());
+                }
+                else
+                {
+                    // the store itself becomes the copy
+                    value.op = IROP::ADD;
+                    value.args = {fresh(), stored, sym_zero};
+                    assign(v, value.args[0]);
+                    it++;
+                    continue;
+                }
+                it = block->values.erase(it);
+                continue;
+            }
+            if (get_irop_info(value.op).binary && symbol_info(value.args[1]).is_num && symbol_info(value.args[2]).is_num)
+            {
+                replace[value.args[0]] = intern(std::to_string(fold(value.op, symbol_info(value.args[1]).num, symbol_info(value.args[2]).num)));
+                dead[value.args[0]] = true;
+                it = block->values.erase(it);
+                continue;
+            }
+            int def = def_index(value.op);
+            if (def >= 0)
+                defined[value.args[def]] = &value;
+            if (value.op == IROP::JUMP || value.op == IROP::BR)
+            {
+                unsigned targets = value.op == IROP::JUMP ? 1 : 2;
+                for (unsigned k = 0; k < targets; k++)
+                {
+                    unsigned t = cfg.id(value.args[value.op == IROP::JUMP ? 0 : k + 1]);
+                    auto const &params = cfg.blocks[t]->params;
+                    if (params.empty())
+                        continue;
+                    if (!value.edge_args)
+                        value.edge_args = make_arena<EdgeArgs>(*pool, *pool);
+                    auto &edge = value.edge_args->args[k];
+                    edge.reserve(params.size());
+                    for (unsigned j = 0; j < params.size(); j++)
+                    {
+                        Symbol arg = cur[param_var[t][j]];
+                        // the parameters are written in order, so an argument
+                        // naming an earlier one is read before the edge
+                        if (tables.param_index.count(arg) && tables.param_index.at(arg) < j && params[tables.param_index.at(arg)] == arg)
+                        {
+                            auto copy = copy_of(arg, value.line);
+                            arg = copy->args[0];
+                            block->values.insert(it, std::move(copy));
+                        }
+                        edge.push_back(arg);
+                    }
+                }
+            }
+            it++;
+        }
+        auto const &children = cfg.dom_children[b];
+        for (auto child = children.rbegin(); child != children.rend(); child++)
+            stack.push_back({*child, SIZE_MAX});
+    }
+
+    // the promoted allocs go, and the declarations of replaced temporaries
+    // declare the new values instead; the pool does not reuse what is erased
+    auto name = new_names.begin();
+    for (auto it = entry->values.begin(); it != entry->values.end();)
+    {
+        auto &value = *it;
+        bool dead_decl = value->op == IROP::NOTE && value->args[0] == sym_decl && dead.count(value->args[1]);
+        if (dead_decl && name != new_names.end())
+            value->args[1] = *name++, it++;
+        else if (dead_decl || (value->op == IROP::ALLOC && var_id.count(value->args[0])))
+            it = entry->values.erase(it);
+        else
+            it++;
+    }
+    for (auto it = new_names.rbegin(); it != std::make_reverse_iterator(name); it++)
+    {
+        auto decl = make_arena<ValueIR>(*pool, *pool, IROP::NOTE);
+        decl->args = {sym_decl, *it, sym_i32};
+        entry->values.push_front(std::move(decl));
+    }
+    // nothing later looks at dominance; the function waits for the backend
+    // with the rest of the program, so the trees are not kept around
+    std::vector<unsigned>().swap(cfg.idom);
+    std::vector<std::vector<unsigned>>().swap(cfg.dom_children);
+    std::vector<std::vector<unsigned>>().swap(cfg.frontier);
+}
@@ -0,0 +1,52 @@
+#include <symbol.h>
+#include <str.h>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+#define SYMBOL_CHUNK_BITS 14
+#define SYMBOL_CHUNK_SIZE (1 << SYMBOL_CHUNK_BITS)
+#define SYMBOL_CHUNKS (1 << 16)
+
+struct SymbolTable
+{
+    // chunks never move once allocated, so symbol_info can read a symbol it
+    // was handed without locking while other threads intern new ones
+    std::unique_ptr<SymbolInfo[]> chunks[SYMBOL_CHUNKS];
+    Symbol size = 0;
+    std::unordered_map<std::string_view, Symbol> index;
+    std::mutex mutex;
+};
+
+// built on first use, so other translation units may intern during static init
+static SymbolTable &table()
+{
+    static SymbolTable instance;
+    return instance;
+}
+
+Symbol intern(std::string_view name)
+{
+    auto &t = table();
+    std::lock_guard<std::mutex> lock(t.mutex);
+    auto it = t.index.find(name);
+    if (it != t.index.end())
+        return it->second;
+    Symbol sym = t.size++;
+    auto &chunk = t.chunks[sym >> SYMBOL_CHUNK_BITS];
+    if (!chunk)
+        chunk.reset(new SymbolInfo[SYMBOL_CHUNK_SIZE]);
+    std::string str(name);
+    bool num = is_num(str);
+    auto &info = chunk[sym & (SYMBOL_CHUNK_SIZE - 1)];
+    info = {str, num, !str.empty() && is_var(str), !str.empty() && is_allocvar(str),
+            num ? (int)strtoll(str.c_str(), nullptr, 10) : 0};
+    t.index.emplace(info.name, sym);
+    return sym;
+}
+
+const SymbolInfo &symbol_info(Symbol sym)
+{
+    return table().chunks[sym >> SYMBOL_CHUNK_BITS][sym & (SYMBOL_CHUNK_SIZE - 1)];
+}
@@ -0,0 +1,134 @@
+#include <timer.h>
+#include <algorithm>
+#include <ctime>
+#include <iomanip>
+#include <mutex>
+#include <sys/resource.h>
+
+TimeReport *time_report = nullptr;
+
+TimeSample TimeSample::now()
+{
+    TimeSample sample;
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    sample.wall = ts.tv_sec + ts.tv_nsec * 1e-9;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    sample.cpu = ts.tv_sec + ts.tv_nsec * 1e-9;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    sample.process_cpu = ts.tv_sec + ts.tv_nsec * 1e-9;
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    sample.peak_rss = usage.ru_maxrss;
+    return sample;
+}
+
+void TimeRecord::add(const TimeSample &start, const TimeSample &end)
+{
+    wall += end.wall - start.wall;
+    cpu += end.cpu - start.cpu;
+    rss_delta += end.peak_rss - start.peak_rss;
+    calls++;
+}
+
+PhaseRecord &TimeReport::get_phase(const std::string name)
+{
+    for (auto &phase : phases)
+        if (phase.name == name)
+            return phase;
+    phases.emplace_back();
+    phases.back().name = name;
+    return phases.back();
+}
+
+PhaseTimer::~PhaseTimer()
+{
+    if (!time_report)
+        return;
+    // functions may be lowered on several threads at once
+    static std::mutex mutex;
+    auto end = TimeSample::now();
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &record = time_report->get_phase(phase);
+    if (!function)
+    {
+        record.add(start, end);
+        return;
+    }
+    auto index = record.function_index.emplace(*function, record.functions.size());
+    if (index.second)
+    {
+        record.functions.emplace_back();
+        record.functions.back().name = *function;
+    }
+    record.functions[index.first->second].add(start, end);
+}
+
+#define TOP_FUNCTIONS 5
+
+static void print_line(std::ostream &out, const std::string name, const TimeRecord &record, double total_wall)
+{
+    out << "  " << std::left << std::setw(28) << name << std::right << std::fixed << std::setprecision(3)
+        << std::setw(11) << record.wall * 1e3
+        << std::setprecision(1) << std::setw(6) << (total_wall > 0 ? record.wall / total_wall * 100 : 0.0) << "%"
+        << std::setprecision(3) << std::setw(11) << record.cpu * 1e3
+        << std::setw(11) << record.rss_delta << std::endl;
+}
+
+void TimeReport::print_text(std::ostream &out) const
+{
+    auto end = TimeSample::now();
+    TimeRecord total;
+    total.add(start, end);
+    total.cpu = end.process_cpu - start.process_cpu;
+    out << "===== time report =====" << std::endl;
+    out << "  " << std::left << std::setw(28) << "phase" << std::right << std::setw(11) << "wall(ms)" << std::setw(7) << ""
+        << std::setw(11) << "cpu(ms)" << std::setw(11) << "rss+(KB)" << std::endl;
+    for (auto &phase : phases)
+    {
+        print_line(out, phase.name, phase, total.wall);
+        auto functions = phase.functions;
+        std::sort(functions.begin(), functions.end(), [](const TimeRecord &a, const TimeRecord &b) { return a.wall > b.wall; });
+        if (functions.size() > TOP_FUNCTIONS)
+            functions.resize(TOP_FUNCTIONS);
+        for (auto &function : functions)
+            print_line(out, "    " + function.name, function, total.wall);
+        if (phase.functions.size() > TOP_FUNCTIONS)
+            out << "      ... " << phase.functions.size() - TOP_FUNCTIONS << " more functions" << std::endl;
+    }
+    print_line(out, "total", total, total.wall);
+    out << "  peak rss: " << end.peak_rss << " KB" << std::endl;
+}
+
+static void print_json_record(std::ostream &out, const TimeRecord &record)
+{
+    out << "\"name\": \"" << record.name << "\", " << std::fixed << std::setprecision(3)
+        << "\"wall_ms\": " << record.wall * 1e3 << ", \"cpu_ms\": " << record.cpu * 1e3
+        << ", \"peak_rss_delta_kb\": " << record.rss_delta << ", \"calls\": " << record.calls;
+}
+
+void TimeReport::print_json(std::ostream &out) const
+{
+    auto end = TimeSample::now();
+    TimeRecord total;
+    total.name = "total";
+    total.add(start, end);
+    total.cpu = end.process_cpu - start.process_cpu;
+    out << "{\"phases\": [";
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        out << (i ? ",\n  {" : "\n  {");
+        print_json_record(out, phases[i]);
+        out << ", \"functions\": [";
+        for (size_t j = 0; j < phases[i].functions.size(); j++)
+        {
+            out << (j ? ",\n    {" : "\n    {");
+            print_json_record(out, phases[i].functions[j]);
+            out << "}";
+        }
+        out << "]}";
+    }
+    out << "],\n \"total\": {";
+    print_json_record(out, total);
+    out << "},\n \"peak_rss_kb\": " << end.peak_rss << "}" << std::endl;
+}
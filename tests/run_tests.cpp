@@ -0,0 +1,200 @@
+// Compiles every .sy test in the given directories with -riscv, runs the
+// output on rv_sim with the .in file next to the test as input and compares
+// what it prints with the .out file. Each test must also compile with -koopa.
+// usage: run_tests --compiler <path> --sim <path> --work <dir>
+//                  [--flags "<options>"] [--repeat N] [--batch] <dir>...
+// --flags are passed to every compile. --repeat compiles each test N times
+// and requires the same assembly every time, which with --cache-dir in the
+// flags checks that cached functions come back unchanged. --batch compiles
+// all tests through one --batch manifest instead of a process each.
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <dirent.h>
+#include <fcntl.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+// runs argv with stdin from in_path and stdout and stderr to out_path and
+// err_path (each /dev/null when empty), returns the exit code or -1
+static int run(const std::vector<std::string> &args, const std::string &in_path, const std::string &out_path, const std::string &err_path)
+{
+    std::vector<char *> argv;
+    for (auto &arg : args)
+        argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        int in = open(in_path.empty() ? "/dev/null" : in_path.c_str(), O_RDONLY);
+        int out = open(out_path.empty() ? "/dev/null" : out_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        int err = open(err_path.empty() ? "/dev/null" : err_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        dup2(err, STDERR_FILENO);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status;
+    if (pid < 0 || waitpid(pid, &status, 0) < 0)
+        return -1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::ifstream in(path);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static bool exists(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// the .sy files of dir, by name
+static std::vector<std::string> list_tests(const std::string &dir)
+{
+    std::vector<std::string> tests;
+    if (DIR *d = opendir(dir.c_str()))
+    {
+        while (dirent *entry = readdir(d))
+        {
+            std::string name = entry->d_name;
+            if (name.size() > 3 && name.compare(name.size() - 3, 3, ".sy") == 0)
+                tests.push_back(dir + "/" + name.substr(0, name.size() - 3));
+        }
+        closedir(d);
+    }
+    std::sort(tests.begin(), tests.end());
+    return tests;
+}
+
+int main(int argc, const char *argv[])
+{
+    std::string compiler, sim, work;
+    std::vector<std::string> flags, dirs;
+    int repeat = 1;
+    bool batch = false;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--compiler" && has_value)
+            compiler = argv[++i];
+        else if (arg == "--sim" && has_value)
+            sim = argv[++i];
+        else if (arg == "--work" && has_value)
+            work = argv[++i];
+        else if (arg == "--flags" && has_value)
+        {
+            std::istringstream fields(argv[++i]);
+            for (std::string flag; fields >> flag;)
+                flags.push_back(flag);
+        }
+        else if (arg == "--repeat" && has_value)
+            repeat = std::max(1, atoi(argv[++i]));
+        else if (arg == "--batch")
+            batch = true;
+        else if (arg[0] != '-')
+            dirs.push_back(arg);
+        else
+        {
+            std::cerr << "unknown argument " << arg << std::endl;
+            return 2;
+        }
+    }
+    if (compiler.empty() || sim.empty() || work.empty() || dirs.empty())
+    {
+        std::cerr << "usage: " << argv[0] << " --compiler <path> --sim <path> --work <dir> [--flags \"<options>\"] [--repeat N] [--batch] <dir>..."
+                  << std::endl;
+        return 2;
+    }
+    mkdir(work.c_str(), 0755);
+    std::vector<std::string> tests;
+    for (auto &dir : dirs)
+        for (auto &test : list_tests(dir))
+            tests.push_back(test);
+    if (tests.empty())
+    {
+        std::cerr << "no tests found" << std::endl;
+        return 2;
+    }
+
+    auto output = [&](const std::string &test, const char *ext)
+    { return work + "/" + test.substr(test.rfind('/') + 1) + ext; };
+    auto compile_args = [&](const std::string &test, const char *mode, const std::string &out)
+    {
+        std::vector<std::string> args = {compiler, mode, test + ".sy", "-o", out};
+        args.insert(args.end(), flags.begin(), flags.end());
+        return args;
+    };
+    // failure reasons by test, empty when it passed
+    std::vector<std::string> failed(tests.size());
+    if (batch)
+    {
+        std::string manifest = work + "/manifest";
+        std::ofstream lines(manifest);
+        for (auto &test : tests)
+            for (auto mode : {"-koopa", "-riscv"})
+            {
+                // a manifest line leaves out the program name
+                auto args = compile_args(test, mode, output(test, mode[1] == 'k' ? ".koopa" : ".S"));
+                for (size_t i = 1; i < args.size(); i++)
+                    lines << (i > 1 ? " " : "") << args[i];
+                lines << std::endl;
+            }
+        lines.close();
+        // the manifest fails as a whole, the missing output shows which test
+        for (auto ext : {".koopa", ".S"})
+            for (auto &test : tests)
+                unlink(output(test, ext).c_str());
+        run({compiler, "--batch=" + manifest}, "", "", work + "/batch.err");
+        for (size_t t = 0; t < tests.size(); t++)
+            for (auto ext : {".koopa", ".S"})
+                if (failed[t].empty() && !exists(output(tests[t], ext)))
+                    failed[t] = std::string("no ") + ext + " output from the batch";
+    }
+    for (size_t t = 0; t < tests.size(); t++)
+    {
+        const std::string &test = tests[t];
+        std::string asm_path = output(test, ".S"), err_path = output(test, ".err");
+        if (!batch && run(compile_args(test, "-koopa", output(test, ".koopa")), "", "", err_path) != 0)
+            failed[t] = "-koopa failed, see " + err_path;
+        std::string first;
+        for (int r = 0; r < repeat && !batch && failed[t].empty(); r++)
+        {
+            if (run(compile_args(test, "-riscv", asm_path), "", "", err_path) != 0)
+                failed[t] = "-riscv failed, see " + err_path;
+            else if (!r)
+                first = read_file(asm_path);
+            else if (read_file(asm_path) != first)
+                failed[t] = "compile " + std::to_string(r + 1) + " gave different assembly";
+        }
+        if (!failed[t].empty())
+            continue;
+        std::string input = exists(test + ".in") ? test + ".in" : "", result = output(test, ".res");
+        int code = run({sim, asm_path, input.empty() ? "/dev/null" : input}, "", result, err_path);
+        if (code != 0)
+            failed[t] = (code == 2 ? "assembly rejected, see " : "program faulted, see ") + err_path;
+        else if (read_file(result) != read_file(test + ".out"))
+            failed[t] = "wrong output, compare " + result + " with " + test + ".out";
+    }
+    size_t failures = 0;
+    for (size_t t = 0; t < tests.size(); t++)
+        if (!failed[t].empty())
+        {
+            printf("FAIL %s: %s\n", tests[t].c_str(), failed[t].c_str());
+            failures++;
+        }
+    printf("%zu passed, %zu failed\n", tests.size() - failures, failures);
+    return failures ? 1 : 0;
+}
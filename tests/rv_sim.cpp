@@ -0,0 +1,554 @@
+// RV32 simulator for the assembly the compiler emits, with the SysY runtime
+// library built in. It lays the text out as an assembler would, rejects
+// branches whose target is out of their reach, and then runs main.
+// usage: rv_sim <file.S> [input] [--stats] [--max-steps N]
+// Prints what the program writes and then its exit code on a line of its
+// own, the layout of the tests' .out files. Exits with 0 when the program
+// ran, 1 when it faulted or ran too long and 2 when the assembly is bad.
+// --stats prints the instructions run, the loads and stores, and the loads
+// and stores marked "# spill" (see --spill-stats) to stderr.
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class Op
+{
+    LI, LA, MV, NEG, NOT, SEQZ, SNEZ,
+    ADD, SUB, MUL, DIV, REM, AND, OR, XOR, SLL, SRL, SRA, SLT, SLTU, SGT,
+    ADDI, ANDI, ORI, XORI, SLLI, SRLI, SRAI, SLTI, SLTIU,
+    LW, SW, J, CALL, RET, NOP,
+    BEQZ, BNEZ, BEQ, BNE, BLT, BGE, BGT, BLE, BLTU, BGEU
+};
+
+enum class Form
+{
+    RD_IMM,    // li
+    RD_LABEL,  // la
+    RD_RS,     // mv, neg, not, seqz, snez
+    RD_RS_RS,  // add
+    RD_RS_IMM, // addi
+    MEM,       // lw, sw
+    LABEL,     // j, call
+    NONE,      // ret, nop
+    RS_LABEL,  // beqz
+    RS_RS_LABEL
+};
+
+static const std::unordered_map<std::string, std::pair<Op, Form>> ops = {
+    {"li", {Op::LI, Form::RD_IMM}}, {"la", {Op::LA, Form::RD_LABEL}},
+    {"mv", {Op::MV, Form::RD_RS}}, {"neg", {Op::NEG, Form::RD_RS}}, {"not", {Op::NOT, Form::RD_RS}},
+    {"seqz", {Op::SEQZ, Form::RD_RS}}, {"snez", {Op::SNEZ, Form::RD_RS}},
+    {"add", {Op::ADD, Form::RD_RS_RS}}, {"sub", {Op::SUB, Form::RD_RS_RS}}, {"mul", {Op::MUL, Form::RD_RS_RS}},
+    {"div", {Op::DIV, Form::RD_RS_RS}}, {"rem", {Op::REM, Form::RD_RS_RS}}, {"and", {Op::AND, Form::RD_RS_RS}},
+    {"or", {Op::OR, Form::RD_RS_RS}}, {"xor", {Op::XOR, Form::RD_RS_RS}}, {"sll", {Op::SLL, Form::RD_RS_RS}},
+    {"srl", {Op::SRL, Form::RD_RS_RS}}, {"sra", {Op::SRA, Form::RD_RS_RS}}, {"slt", {Op::SLT, Form::RD_RS_RS}},
+    {"sltu", {Op::SLTU, Form::RD_RS_RS}}, {"sgt", {Op::SGT, Form::RD_RS_RS}},
+    {"addi", {Op::ADDI, Form::RD_RS_IMM}}, {"andi", {Op::ANDI, Form::RD_RS_IMM}}, {"ori", {Op::ORI, Form::RD_RS_IMM}},
+    {"xori", {Op::XORI, Form::RD_RS_IMM}}, {"slli", {Op::SLLI, Form::RD_RS_IMM}}, {"srli", {Op::SRLI, Form::RD_RS_IMM}},
+    {"srai", {Op::SRAI, Form::RD_RS_IMM}}, {"slti", {Op::SLTI, Form::RD_RS_IMM}}, {"sltiu", {Op::SLTIU, Form::RD_RS_IMM}},
+    {"lw", {Op::LW, Form::MEM}}, {"sw", {Op::SW, Form::MEM}},
+    {"j", {Op::J, Form::LABEL}}, {"call", {Op::CALL, Form::LABEL}}, {"ret", {Op::RET, Form::NONE}}, {"nop", {Op::NOP, Form::NONE}},
+    {"beqz", {Op::BEQZ, Form::RS_LABEL}}, {"bnez", {Op::BNEZ, Form::RS_LABEL}},
+    {"beq", {Op::BEQ, Form::RS_RS_LABEL}}, {"bne", {Op::BNE, Form::RS_RS_LABEL}}, {"blt", {Op::BLT, Form::RS_RS_LABEL}},
+    {"bge", {Op::BGE, Form::RS_RS_LABEL}}, {"bgt", {Op::BGT, Form::RS_RS_LABEL}}, {"ble", {Op::BLE, Form::RS_RS_LABEL}},
+    {"bltu", {Op::BLTU, Form::RS_RS_LABEL}}, {"bgeu", {Op::BGEU, Form::RS_RS_LABEL}}};
+
+static const char *reg_names[32] = {"zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "fp", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+                                    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+// the runtime library, called by name; the first four return a value
+static const char *lib_names[] = {"getint", "getch", "getarray", "putint", "putch", "putarray",
+                                  "starttime", "stoptime", "_sysy_starttime", "_sysy_stoptime"};
+static const int LIB_NUM = sizeof(lib_names) / sizeof(lib_names[0]);
+static const int LIB_RESULTS = 3;
+
+static const uint32_t TEXT_BASE = 0x1000;
+static const uint32_t DATA_BASE = 0x10000;
+static const uint32_t STACK_END = 0x80000000u, STACK_TOP = 0x7ff00000u, STACK_SIZE = 256u << 20;
+// what ra holds when main is entered, returning to it ends the program
+static const int32_t EXIT_PC = -1;
+
+struct Insn
+{
+    Op op;
+    int rd = 0, rs1 = 0, rs2 = 0;
+    int32_t imm = 0;
+    std::string label;
+    // index of the target instruction, or -1 - the library function
+    int target = 0;
+    uint32_t addr = 0;
+    unsigned line = 0;
+    bool spill = false;
+};
+
+class Machine
+{
+public:
+    std::vector<Insn> code;
+    std::unordered_map<std::string, int> text_labels;
+    std::unordered_map<std::string, uint32_t> data_labels;
+    std::vector<int32_t> data;
+    std::vector<int32_t> stack;
+    int32_t regs[32] = {0};
+    std::string input, output;
+    size_t input_pos = 0;
+    uint64_t steps = 0, loads = 0, stores = 0, spill_loads = 0, spill_stores = 0;
+    std::string error;
+
+    bool assemble(std::istream &in);
+    bool run(uint64_t max_steps);
+
+private:
+    int32_t *word(uint32_t addr);
+    int32_t read_int();
+    void call_lib(int lib);
+};
+
+static std::string trim(const std::string &s)
+{
+    size_t b = s.find_first_not_of(" \t\r"), e = s.find_last_not_of(" \t\r");
+    return b == std::string::npos ? "" : s.substr(b, e - b + 1);
+}
+
+static int reg_index(const std::string &name)
+{
+    if (name == "s0")
+        return 8;
+    for (int i = 0; i < 32; i++)
+        if (name == reg_names[i])
+            return i;
+    return -1;
+}
+
+static bool parse_imm(const std::string &text, int32_t &value)
+{
+    char *end;
+    long long v = strtoll(text.c_str(), &end, 0);
+    if (text.empty() || *end || v < INT32_MIN || v > UINT32_MAX)
+        return false;
+    value = (int32_t)(uint32_t)v;
+    return true;
+}
+
+// bytes the assembler gives an instruction: li of a large constant, la and
+// call take two
+static uint32_t insn_size(const Insn &insn)
+{
+    if (insn.op == Op::LI)
+        return (insn.imm >= -2048 && insn.imm < 2048) || (insn.imm & 0xfff) == 0 ? 4 : 8;
+    return insn.op == Op::LA || insn.op == Op::CALL ? 8 : 4;
+}
+
+bool Machine::assemble(std::istream &in)
+{
+    std::string raw;
+    bool in_data = false, spill = false;
+    std::vector<std::pair<std::string, unsigned>> words;
+    uint32_t data_ptr = DATA_BASE;
+    auto fail = [&](unsigned line, const std::string &what)
+    {
+        error = "line " + std::to_string(line) + ": " + what;
+        return false;
+    };
+    for (unsigned line = 1; std::getline(in, raw); line++)
+    {
+        std::string text = trim(raw);
+        if (text.empty())
+            continue;
+        if (text[0] == '#')
+        {
+            spill |= trim(text.substr(1)) == "spill";
+            continue;
+        }
+        text = trim(text.substr(0, text.find('#')));
+        if (text.back() == ':' && text.find_first_of(" \t") == std::string::npos)
+        {
+            std::string label = text.substr(0, text.size() - 1);
+            if (text_labels.count(label) || data_labels.count(label))
+                return fail(line, "label " + label + " defined twice");
+            if (in_data)
+                data_labels[label] = data_ptr;
+            else
+                text_labels[label] = code.size();
+            continue;
+        }
+        for (auto &c : text)
+            if (c == ',')
+                c = ' ';
+        std::istringstream fields(text);
+        std::vector<std::string> parts;
+        for (std::string part; fields >> part;)
+            parts.push_back(part);
+        const std::string &name = parts[0];
+        if (name[0] == '.')
+        {
+            if (name == ".data")
+                in_data = true;
+            else if (name == ".text")
+                in_data = false;
+            else if (name == ".section")
+                in_data = parts.size() > 1 && (parts[1] == ".data" || parts[1] == ".rodata" || parts[1] == ".bss");
+            else if (name == ".word" || name == ".zero" || name == ".p2align" || name == ".align")
+            {
+                int32_t value;
+                if (!in_data || parts.size() != 2 || !parse_imm(parts[1], value))
+                    return fail(line, "bad " + name);
+                if (name == ".word")
+                    words.push_back({parts[1], line}), data_ptr += 4;
+                else if (name == ".zero")
+                {
+                    if (value % 4)
+                        return fail(line, ".zero of a size that is not whole words");
+                    for (int32_t i = 0; i < value; i += 4)
+                        words.push_back({"0", line});
+                    data_ptr += value;
+                }
+                else
+                    for (uint32_t align = 1u << value; data_ptr % align; data_ptr += 4)
+                        words.push_back({"0", line});
+            }
+            // .globl, .loc, .file and the like change nothing here
+            continue;
+        }
+        if (in_data)
+            return fail(line, "instruction in a data section");
+        auto it = ops.find(name);
+        if (it == ops.end())
+            return fail(line, "unknown instruction " + name);
+        Insn insn;
+        insn.op = it->second.first;
+        insn.line = line;
+        // a large frame offset puts li and sub between the mark and the access
+        if (insn.op == Op::LW || insn.op == Op::SW)
+            insn.spill = spill, spill = false;
+        static const unsigned operands[] = {2, 2, 2, 3, 3, 2, 1, 0, 2, 3};
+        Form form = it->second.second;
+        if (parts.size() != operands[int(form)] + 1)
+            return fail(line, "wrong number of operands for " + name);
+        auto reg = [&](const std::string &part, int &index)
+        {
+            index = reg_index(part);
+            return index >= 0;
+        };
+        bool ok = true;
+        switch (form)
+        {
+        case Form::RD_IMM: ok = reg(parts[1], insn.rd) && parse_imm(parts[2], insn.imm); break;
+        case Form::RD_LABEL: ok = reg(parts[1], insn.rd), insn.label = parts[2]; break;
+        case Form::RD_RS: ok = reg(parts[1], insn.rd) && reg(parts[2], insn.rs1); break;
+        case Form::RD_RS_RS: ok = reg(parts[1], insn.rd) && reg(parts[2], insn.rs1) && reg(parts[3], insn.rs2); break;
+        case Form::RD_RS_IMM:
+            ok = reg(parts[1], insn.rd) && reg(parts[2], insn.rs1) && parse_imm(parts[3], insn.imm) && insn.imm >= -2048 && insn.imm < 2048;
+            break;
+        case Form::MEM:
+        {
+            size_t open = parts[2].find('('), close = parts[2].find(')');
+            ok = reg(parts[1], insn.op == Op::LW ? insn.rd : insn.rs2) && open != std::string::npos && close == parts[2].size() - 1 &&
+                 parse_imm(parts[2].substr(0, open), insn.imm) && insn.imm >= -2048 && insn.imm < 2048 &&
+                 reg(parts[2].substr(open + 1, close - open - 1), insn.rs1);
+            break;
+        }
+        case Form::LABEL: insn.label = parts[1]; break;
+        case Form::NONE: break;
+        case Form::RS_LABEL: ok = reg(parts[1], insn.rs1), insn.label = parts[2]; break;
+        case Form::RS_RS_LABEL: ok = reg(parts[1], insn.rs1) && reg(parts[2], insn.rs2), insn.label = parts[3]; break;
+        }
+        if (!ok)
+            return fail(line, "bad operands for " + name);
+        code.push_back(insn);
+    }
+
+    uint32_t addr = TEXT_BASE;
+    for (auto &insn : code)
+        insn.addr = addr, addr += insn_size(insn);
+    for (auto &insn : code)
+    {
+        if (insn.label.empty() || insn.op == Op::LA)
+            continue;
+        auto target = text_labels.find(insn.label);
+        if (target == text_labels.end())
+        {
+            int lib = 0;
+            while (lib < LIB_NUM && insn.label != lib_names[lib])
+                lib++;
+            if (insn.op != Op::CALL || lib == LIB_NUM)
+                return fail(insn.line, "undefined label " + insn.label);
+            insn.target = -1 - lib;
+            continue;
+        }
+        insn.target = target->second;
+        // a label at the very end has no instruction of its own
+        int64_t offset = (int64_t)(target->second < (int)code.size() ? code[target->second].addr : addr) - insn.addr;
+        int64_t reach = insn.op == Op::J || insn.op == Op::CALL ? 1 << 20 : 1 << 12;
+        if (insn.op != Op::CALL && (offset < -reach || offset >= reach))
+            return fail(insn.line, "branch to " + insn.label + " out of range (" + std::to_string(offset) + " bytes)");
+    }
+    for (auto &insn : code)
+        if (insn.op == Op::LA)
+        {
+            if (data_labels.count(insn.label))
+                insn.imm = data_labels[insn.label];
+            else if (text_labels.count(insn.label))
+                insn.imm = code[text_labels[insn.label]].addr;
+            else
+                return fail(insn.line, "undefined label " + insn.label);
+        }
+    for (auto &word : words)
+    {
+        int32_t value;
+        if (!parse_imm(word.first, value))
+            return fail(word.second, "bad .word " + word.first);
+        data.push_back(value);
+    }
+    if (!text_labels.count("main"))
+        return fail(0, "no main");
+    return true;
+}
+
+int32_t *Machine::word(uint32_t addr)
+{
+    if (addr % 4)
+        return nullptr;
+    if (addr >= DATA_BASE && addr - DATA_BASE < data.size() * 4)
+        return &data[(addr - DATA_BASE) / 4];
+    if (addr < STACK_END && addr >= STACK_END - STACK_SIZE)
+    {
+        size_t index = (STACK_END - 4 - addr) / 4;
+        if (index >= stack.size())
+            stack.resize(std::max(index + 1, stack.size() * 2));
+        return &stack[index];
+    }
+    return nullptr;
+}
+
+int32_t Machine::read_int()
+{
+    while (input_pos < input.size() && isspace((unsigned char)input[input_pos]))
+        input_pos++;
+    size_t end = input_pos;
+    if (end < input.size() && (input[end] == '-' || input[end] == '+'))
+        end++;
+    while (end < input.size() && isdigit((unsigned char)input[end]))
+        end++;
+    int32_t value = (int32_t)(uint32_t)strtoll(input.substr(input_pos, end - input_pos).c_str(), nullptr, 10);
+    input_pos = end;
+    return value;
+}
+
+void Machine::call_lib(int lib)
+{
+    int32_t &a0 = regs[10];
+    switch (lib)
+    {
+    case 0: a0 = read_int(); break;
+    case 1: a0 = input_pos < input.size() ? (unsigned char)input[input_pos++] : -1; break;
+    case 2:
+    {
+        int32_t n = read_int();
+        for (int32_t i = 0; i < n; i++)
+            if (int32_t *p = word(a0 + 4 * i))
+                *p = read_int();
+        a0 = n;
+        break;
+    }
+    case 3: output += std::to_string(a0); break;
+    case 4: output += (char)a0; break;
+    case 5:
+    {
+        output += std::to_string(a0) + ":";
+        for (int32_t i = 0; i < a0; i++)
+        {
+            int32_t *p = word(regs[11] + 4 * i);
+            output += " " + std::to_string(p ? *p : 0);
+        }
+        output += "\n";
+        break;
+    }
+    default: break;
+    }
+    // the callee may leave anything in the caller-saved registers
+    static const int clobbered[] = {5, 6, 7, 11, 12, 13, 14, 15, 16, 17, 28, 29, 30, 31};
+    for (int r : clobbered)
+        regs[r] = (int32_t)(0x5eed0000u + 977u * r + (uint32_t)steps);
+    if (lib > LIB_RESULTS - 1)
+        regs[10] = (int32_t)(0x5eed0000u + (uint32_t)steps);
+}
+
+bool Machine::run(uint64_t max_steps)
+{
+    regs[2] = (int32_t)STACK_TOP;
+    regs[1] = EXIT_PC;
+    int pc = text_labels["main"];
+    auto fault = [&](const Insn &insn, const std::string &what)
+    {
+        error = "line " + std::to_string(insn.line) + ": " + what;
+        return false;
+    };
+    while (pc != EXIT_PC)
+    {
+        if (pc < 0 || pc >= (int)code.size())
+        {
+            error = "jumped outside the text to " + std::to_string(pc);
+            return false;
+        }
+        if (++steps > max_steps)
+        {
+            error = "more than " + std::to_string(max_steps) + " instructions";
+            return false;
+        }
+        const Insn &insn = code[pc++];
+        int32_t a = regs[insn.rs1], b = regs[insn.rs2], result = 0;
+        uint32_t ua = a, ub = b;
+        bool write = true;
+        switch (insn.op)
+        {
+        case Op::LI: case Op::LA: result = insn.imm; break;
+        case Op::MV: result = a; break;
+        case Op::NEG: result = (int32_t)(0u - ua); break;
+        case Op::NOT: result = ~a; break;
+        case Op::SEQZ: result = a == 0; break;
+        case Op::SNEZ: result = a != 0; break;
+        case Op::ADD: result = (int32_t)(ua + ub); break;
+        case Op::SUB: result = (int32_t)(ua - ub); break;
+        case Op::MUL: result = (int32_t)(ua * ub); break;
+        case Op::DIV: result = !b ? -1 : (a == INT32_MIN && b == -1) ? a : a / b; break;
+        case Op::REM: result = !b ? a : (a == INT32_MIN && b == -1) ? 0 : a % b; break;
+        case Op::AND: result = a & b; break;
+        case Op::OR: result = a | b; break;
+        case Op::XOR: result = a ^ b; break;
+        case Op::SLL: result = (int32_t)(ua << (ub & 31)); break;
+        case Op::SRL: result = (int32_t)(ua >> (ub & 31)); break;
+        case Op::SRA: result = a >> (ub & 31); break;
+        case Op::SLT: result = a < b; break;
+        case Op::SLTU: result = ua < ub; break;
+        case Op::SGT: result = a > b; break;
+        case Op::ADDI: result = (int32_t)(ua + (uint32_t)insn.imm); break;
+        case Op::ANDI: result = a & insn.imm; break;
+        case Op::ORI: result = a | insn.imm; break;
+        case Op::XORI: result = a ^ insn.imm; break;
+        case Op::SLLI: result = (int32_t)(ua << (insn.imm & 31)); break;
+        case Op::SRLI: result = (int32_t)(ua >> (insn.imm & 31)); break;
+        case Op::SRAI: result = a >> (insn.imm & 31); break;
+        case Op::SLTI: result = a < insn.imm; break;
+        case Op::SLTIU: result = ua < (uint32_t)insn.imm; break;
+        case Op::LW:
+        {
+            int32_t *p = word(ua + (uint32_t)insn.imm);
+            if (!p)
+                return fault(insn, "load from bad address " + std::to_string((uint32_t)(ua + insn.imm)));
+            result = *p;
+            loads++, spill_loads += insn.spill;
+            break;
+        }
+        case Op::SW:
+        {
+            int32_t *p = word(ua + (uint32_t)insn.imm);
+            if (!p)
+                return fault(insn, "store to bad address " + std::to_string((uint32_t)(ua + insn.imm)));
+            *p = b;
+            stores++, spill_stores += insn.spill;
+            write = false;
+            break;
+        }
+        default:
+        {
+            write = false;
+            bool taken = false;
+            switch (insn.op)
+            {
+            case Op::J: taken = true; break;
+            case Op::NOP: break;
+            case Op::RET: pc = regs[1]; break;
+            case Op::CALL:
+                if (insn.target < 0)
+                    call_lib(-1 - insn.target);
+                else
+                    regs[1] = pc, taken = true;
+                break;
+            case Op::BEQZ: taken = a == 0; break;
+            case Op::BNEZ: taken = a != 0; break;
+            case Op::BEQ: taken = a == b; break;
+            case Op::BNE: taken = a != b; break;
+            case Op::BLT: taken = a < b; break;
+            case Op::BGE: taken = a >= b; break;
+            case Op::BGT: taken = a > b; break;
+            case Op::BLE: taken = a <= b; break;
+            case Op::BLTU: taken = ua < ub; break;
+            case Op::BGEU: taken = ua >= ub; break;
+            default: return fault(insn, "cannot run this instruction");
+            }
+            if (taken)
+                pc = insn.target;
+        }
+        }
+        if (write && insn.rd)
+            regs[insn.rd] = result;
+    }
+    return true;
+}
+
+int main(int argc, const char *argv[])
+{
+    const char *asm_path = nullptr, *input_path = nullptr;
+    bool stats = false;
+    uint64_t max_steps = 1000000000;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--stats")
+            stats = true;
+        else if (arg == "--max-steps" && i + 1 < argc)
+            max_steps = strtoull(argv[++i], nullptr, 10);
+        else if (!asm_path)
+            asm_path = argv[i];
+        else if (!input_path)
+            input_path = argv[i];
+        else
+            asm_path = nullptr, i = argc;
+    }
+    if (!asm_path)
+    {
+        std::cerr << "usage: " << argv[0] << " <file.S> [input] [--stats] [--max-steps N]" << std::endl;
+        return 2;
+    }
+    std::ifstream in(asm_path);
+    if (!in)
+    {
+        std::cerr << "cannot open " << asm_path << std::endl;
+        return 2;
+    }
+    Machine machine;
+    if (!machine.assemble(in))
+    {
+        std::cerr << asm_path << ": " << machine.error << std::endl;
+        return 2;
+    }
+    if (input_path)
+    {
+        std::ifstream input(input_path);
+        machine.input.assign(std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>());
+    }
+    bool ok = machine.run(max_steps);
+    std::string &out = machine.output;
+    if (!out.empty() && out.back() != '\n')
+        out += '\n';
+    std::cout << out << (machine.regs[10] & 0xff) << std::endl;
+    if (stats)
+        fprintf(stderr, "instructions %llu loads %llu stores %llu spill loads %llu spill stores %llu\n",
+                (unsigned long long)machine.steps, (unsigned long long)machine.loads, (unsigned long long)machine.stores,
+                (unsigned long long)machine.spill_loads, (unsigned long long)machine.spill_stores);
+    if (!ok)
+    {
+        std::cerr << asm_path << ": " << machine.error << std::endl;
+        return 1;
+    }
+    return 0;
+}